@@ -8,59 +8,176 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
-#define LOGLEVEL LOGLEVEL_DEBUG
-
-typedef enum vgc_LogLevel {
-    LOGLEVEL_CRITICAL,
-    LOGLEVEL_WARNING,
-    LOGLEVEL_INFO,
-    LOGLEVEL_DEBUG,
-    LOGLEVEL_NONE
-} vgc_LogLevel;
+/*
+ * Log levels are compile-time constants. Messages above `VGC_LOGLEVEL` sit
+ * behind a constant false condition, so they generate no code and their
+ * arguments are never evaluated. With `DISABLE_LOGGING`, no message is
+ * compiled in at all. If set to LOGLEVEL_DEBUG, the garbage collector will
+ * be very chatty.
+ */
+#define LOGLEVEL_CRITICAL 0
+#define LOGLEVEL_WARNING 1
+#define LOGLEVEL_INFO 2
+#define LOGLEVEL_DEBUG 3
 
 #if defined(DISABLE_LOGGING)
+#undef VGC_LOGLEVEL
+#define VGC_LOGLEVEL (-1)
+#elif !defined(VGC_LOGLEVEL)
+#define VGC_LOGLEVEL LOGLEVEL_INFO
+#endif
 
-static const char * log_level_strings [] = { "CRIT", "WARN", "INFO", "DEBG", "NONE" };
+#define VGC_LOG(level, name, fmt, ...) \
+    do { if ((level) <= VGC_LOGLEVEL) fprintf(stderr, "[%s] %s:%s:%llu: " fmt "\n", name, __func__, __FILE__, (long long unsigned int) __LINE__, __VA_ARGS__); } while (0)
 
-#define log(level, fmt, ...) \
-    do { if (level <= LOGLEVEL) fprintf(stderr, "[%s] %s:%s:%llu: " fmt "\n", log_level_strings[level], __func__, __FILE__, (long long unsigned int) __LINE__, __VA_ARGS__); } while (0)
+#define LOG_CRITICAL(fmt, ...) VGC_LOG(LOGLEVEL_CRITICAL, "CRIT", fmt, __VA_ARGS__)
+#define LOG_WARNING(fmt, ...) VGC_LOG(LOGLEVEL_WARNING, "WARN", fmt, __VA_ARGS__)
+#define LOG_INFO(fmt, ...) VGC_LOG(LOGLEVEL_INFO, "INFO", fmt, __VA_ARGS__)
+#define LOG_DEBUG(fmt, ...) VGC_LOG(LOGLEVEL_DEBUG, "DEBG", fmt, __VA_ARGS__)
+
+/**
+ * The event trace buffer.
+ *
+ * A power-of-two ring of fixed-size records. Recording an event takes a
+ * timestamp and a few stores; once the ring is full, the oldest events are
+ * overwritten. Nothing is formatted until the events are read or dumped.
+ */
+typedef struct vgc_TraceBuffer {
+    vgc_TraceEvent *events;         // ring of events
+    size_t mask;                    // capacity - 1
+    size_t head;                    // number of events recorded so far
+} vgc_TraceBuffer;
 
+static void vgc_trace(vgc_GC *gc, vgc_TraceEventType type, uint64_t a, uint64_t b) {
+    vgc_TraceBuffer *tb = gc->trace;
+#if defined(VGC_THREADS)
+    size_t i = __atomic_fetch_add(&tb->head, 1, __ATOMIC_RELAXED) & tb->mask;
 #else
+    size_t i = tb->head++ & tb->mask;
+#endif
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    tb->events[i].time = (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+    tb->events[i].type = (uint32_t) type;
+    tb->events[i].a = a;
+    tb->events[i].b = b;
+}
+
+/**
+ * The allocation recorder.
+ *
+ * Appends a `vgc_RecordEvent` to a file for every allocation, reallocation,
+ * free, collection and swept object. Writes go through stdio's buffer, so
+ * recording an event is usually a copy into memory.
+ */
+typedef struct vgc_Recorder {
+    FILE *file;                     // the trace file
+    bool edges;                     // record pointer edges before every collection
+    bool automatic;                 // the next collection was triggered by an allocation
+    bool failed;                    // a write failed
+    uint64_t *sums;                 // per slot: checksum of the contents last recorded (0 if none)
+    size_t sum_count;               // number of slots in `sums`
+} vgc_Recorder;
 
-static vgc_LogLevel log(vgc_LogLevel log_level, ...)
-{
-    return log_level;
+static void vgc_record(vgc_GC *gc, vgc_RecordType type, uint8_t flags, uint32_t id, uint64_t size, uint32_t arg) {
+    vgc_Recorder *rec = gc->recorder;
+    vgc_RecordEvent event;
+    memset(&event, 0, sizeof(event));
+    event.type = (uint8_t) type;
+    event.flags = flags;
+    event.id = id;
+    event.size = size;
+    event.arg = arg;
+    if (fwrite(&event, sizeof(event), 1, rec->file) != 1) {
+        rec->failed = true;
+    }
+    /* A new or dead object in a slot has no recorded contents */
+    if (type != VGC_RECORD_COLLECT && type != VGC_RECORD_CONTENTS && type != VGC_RECORD_EDGE) {
+        if (id < rec->sum_count) {
+            rec->sums[id] = 0;
+        }
+        if (arg < rec->sum_count) {
+            rec->sums[arg] = 0;
+        }
+    }
 }
 
-#endif // DEBUG
+static void vgc_record_collect(vgc_GC *gc);
 
-#define LOG_CRITICAL(fmt, ...) log(LOGLEVEL_CRITICAL, fmt, __VA_ARGS__)
-#define LOG_WARNING(fmt, ...) log(LOGLEVEL_WARNING, fmt, __VA_ARGS__)
-#define LOG_INFO(fmt, ...) log(LOGLEVEL_INFO, fmt, __VA_ARGS__)
-#define LOG_DEBUG(fmt, ...) log(LOGLEVEL_DEBUG, fmt, __VA_ARGS__)
+static void vgc_record_realloc(vgc_GC *gc, uint32_t id, void *ptr, size_t size);
 
 /*
- * Set log level for this compilation unit. If set to LOGLEVEL_DEBUG,
- * the garbage collector will be very chatty.
+ * The size of a pointer.
  */
-#undef LOGLEVEL
-#define LOGLEVEL LOGLEVEL_INFO
+#define VGC_PTRSIZE sizeof(void *)
 
 /*
- * The size of a pointer.
+ * The size of a cache line. Compact arrays and buffers align their payload
+ * to this boundary so that the header never shares a line with the data.
  */
-#define VGC_PTRSIZE sizeof(void *)
+#if !defined(VGC_CACHE_LINE_SIZE)
+#define VGC_CACHE_LINE_SIZE 64
+#endif
+
+/*
+ * The number of buckets that every insert or removal migrates while the
+ * allocation map is being resized.
+ */
+#if !defined(VGC_REHASH_STEP)
+#define VGC_REHASH_STEP 16
+#endif
+
+/*
+ * Round `n` up to the next multiple of `alignment` (a power of two).
+ */
+#define VGC_ALIGN_UP(n, alignment) (((n) + (alignment) - 1) & ~((size_t) (alignment) - 1))
 
 /*
- * Allocations can temporarily be tagged as "marked" an part of the
- * mark-and-sweep implementation or can be tagged as "roots" which are
- * not automatically garbage collected. The latter allows the implementation
- * of global variables.
+ * Allocations can be tagged as "roots" which are not automatically garbage
+ * collected. This allows the implementation of global variables. Allocations
+ * promoted out of a region are tagged as "span" allocations; their memory is
+ * owned by a span and must not be passed to free(). Allocations tagged as
+ * "noscan" hold no pointers; they are marked but never scanned. Allocations
+ * tagged as "weak" may be the target of a weak reference or the key of a
+ * weak map. Allocations tagged as "interned" are shared strings owned by
+ * the interning table; they cannot be freed or reallocated. Marks are not
+ * tags; they live in the side bitmaps of the allocation map.
  */
 #define VGC_TAG_NONE 0x0
 #define VGC_TAG_ROOT 0x1
-#define VGC_TAG_MARK 0x2
+#define VGC_TAG_SPAN 0x4
+#define VGC_TAG_NOSCAN 0x8
+#define VGC_TAG_WEAK 0x10
+#define VGC_TAG_INTERNED 0x20
+
+/*
+ * Allocation objects are handed out in pages of 256 slots, which makes
+ * the per-page share of each side bitmap exactly one 256-bit vector.
+ */
+#define VGC_PAGE_SLOTS 256
+#define VGC_PAGE_WORDS (VGC_PAGE_SLOTS / 64)
+
+#define VGC_SLOT_WORD(slot) ((slot) / 64)
+#define VGC_SLOT_MASK(slot) ((uint64_t) 1 << ((slot) % 64))
+
+/*
+ * With `VGC_THREADS`, stripes take unused slots in batches of a cache line's
+ * worth of bitmap bits, so the atomic updates of the live and mark bits of
+ * different stripes rarely land on the same bitmap words.
+ */
+#if !defined(VGC_STRIPE_BATCH)
+#define VGC_STRIPE_BATCH (VGC_CACHE_LINE_SIZE * 8)
+#endif
+
+/*
+ * Objects larger than a quarter of the default span size get a span of
+ * their own.
+ */
+#if !defined(VGC_SPAN_SIZE)
+#define VGC_SPAN_SIZE (64 * 1024)
+#endif
 
 /*
  * Support for windows c compiler is added by adding this macro.
@@ -70,6 +187,97 @@ static vgc_LogLevel log(vgc_LogLevel log_level, ...)
 #include <intrin.h>
 
 #define __builtin_frame_address(x)  ((void)(x), _AddressOfReturnAddress())
+#define VGC_PREFETCH(addr)          _mm_prefetch((const char *) (addr), _MM_HINT_T0)
+#define VGC_NOINLINE                __declspec(noinline)
+#else
+#define VGC_PREFETCH(addr)          __builtin_prefetch(addr)
+#define VGC_NOINLINE                __attribute__((noinline))
+#endif
+
+/*
+ * The scan kernels use SSE4.2/AVX2 on x86 (selected at runtime, so the
+ * library itself can be built for a baseline target) and NEON on AArch64.
+ * Define VGC_NO_SIMD to always use the scalar kernel.
+ */
+#if !defined(VGC_NO_SIMD)
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define VGC_SCAN_X86
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define VGC_SCAN_NEON
+#include <arm_neon.h>
+#endif
+#endif // VGC_NO_SIMD
+
+#if defined(__AVX2__) && !defined(VGC_SCAN_X86)
+#include <immintrin.h>
+#endif
+
+/*
+ * Snapshot collections fork a marker child and are only available on Linux.
+ */
+#if defined(__linux__) && !defined(VGC_NO_SNAPSHOT)
+#define VGC_SNAPSHOT
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/*
+ * Dirty page tracking uses soft-dirty bits or write protection, both Linux only.
+ */
+#if defined(__linux__) && !defined(VGC_NO_DIRTY_TRACKING)
+#define VGC_DIRTY_TRACKING
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/*
+ * The usable size of a system allocation. Growing a block within the slack of
+ * its size class does not need to go through realloc() at all.
+ */
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define VGC_USABLE_SIZE(ptr)        malloc_usable_size(ptr)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define VGC_USABLE_SIZE(ptr)        malloc_size(ptr)
+#endif
+
+/*
+ * File-backed buffers need mmap(), which is available on POSIX systems.
+ */
+#if defined(__unix__) || defined(__APPLE__)
+#define VGC_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/*
+ * With VGC_THREADS the allocation map may be used from several threads at
+ * once: bucket chains are published with release stores so that the marker
+ * can walk them without locking, and the side bitmaps and counters are
+ * updated atomically. Without it all of these are plain memory accesses.
+ */
+#if defined(VGC_THREADS)
+#include <pthread.h>
+
+#define VGC_ATOMIC_LOAD(x)          __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define VGC_ATOMIC_STORE(x, v)      __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#define VGC_ATOMIC_ADD(x, v)        __atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+#define VGC_ATOMIC_SUB(x, v)        __atomic_fetch_sub(&(x), (v), __ATOMIC_RELAXED)
+#define VGC_ATOMIC_OR(x, v)         __atomic_fetch_or(&(x), (v), __ATOMIC_RELAXED)
+#define VGC_ATOMIC_AND(x, v)        __atomic_fetch_and(&(x), (v), __ATOMIC_RELAXED)
+#else
+#define VGC_ATOMIC_LOAD(x)          (x)
+#define VGC_ATOMIC_STORE(x, v)      ((x) = (v))
+#define VGC_ATOMIC_ADD(x, v)        ((x) += (v))
+#define VGC_ATOMIC_SUB(x, v)        ((x) -= (v))
+#define VGC_ATOMIC_OR(x, v)         ((x) |= (v))
+#define VGC_ATOMIC_AND(x, v)        ((x) &= (v))
 #endif
 
 /*
@@ -83,6 +291,14 @@ static vgc_LogLevel log(vgc_LogLevel log_level, ...)
 vgc_GC *VGC_GLOBAL_GC;
 #endif
 
+#if !defined(vgc__libc_free)
+void (*vgc__libc_free)(void *block) = free;
+#endif
+
+#if !defined(vgc__libc_malloc)
+void * (*vgc__libc_malloc)(size_t size) = malloc;
+#endif
+
 static void vgc__array_set_buffer(vgc_Array *array, vgc_Buffer * value);
 
 static void vgc__array_set_slot_count(vgc_Array *array, size_t value);
@@ -93,6 +309,14 @@ static void vgc__buffer_set_address(vgc_Buffer *buffer, void * value);
 
 static void vgc__buffer_set_length(vgc_Buffer *buffer, size_t value);
 
+static void vgc__vector_set_scanned(vgc_Vector *vector, bool value);
+
+static void vgc__slice_set_parent(vgc_Slice *slice, void * value);
+
+static void vgc__slice_set_address(vgc_Slice *slice, void * value);
+
+static void vgc__slice_set_length(vgc_Slice *slice, size_t value);
+
 static bool is_prime(size_t n) {
     /* https://stackoverflow.com/questions/1538644/c-determine-if-a-number-is-prime */
     if (n <= 3)
@@ -113,37 +337,272 @@ static size_t next_prime(size_t n) {
     return n;
 }
 
+/**
+ * Count the trailing zero bits of a non-zero word.
+ */
+static unsigned vgc_ctz64(uint64_t x) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return (unsigned) index;
+#else
+    return (unsigned) __builtin_ctzll(x);
+#endif
+}
+
+/**
+ * Add a page of allocation objects to an allocation map.
+ *
+ * @param am The allocation map to grow.
+ * @returns `true` on success, `false` if out of memory.
+ */
+static bool vgc_allocation_map_add_page(vgc_AllocationMap *am) {
+    if (am->page_count == am->page_capacity) {
+        size_t capacity = am->page_capacity ? 2 * am->page_capacity : 4;
+        size_t words = capacity * VGC_PAGE_WORDS;
+        vgc_Allocation **pages = (vgc_Allocation **) realloc(am->pages, capacity * sizeof(vgc_Allocation *));
+        if (!pages) {
+            return false;
+        }
+        am->pages = pages;
+        uint64_t *live = (uint64_t *) realloc(am->live, words * sizeof(uint64_t));
+        if (!live) {
+            return false;
+        }
+        am->live = live;
+        uint64_t *marks = (uint64_t *) realloc(am->marks, words * sizeof(uint64_t));
+        if (!marks) {
+            return false;
+        }
+        am->marks = marks;
+        size_t used = am->page_capacity * VGC_PAGE_WORDS;
+        memset(am->live + used, 0, (words - used) * sizeof(uint64_t));
+        memset(am->marks + used, 0, (words - used) * sizeof(uint64_t));
+        am->page_capacity = capacity;
+    }
+    vgc_Allocation *page = (vgc_Allocation *) malloc(VGC_PAGE_SLOTS * sizeof(vgc_Allocation));
+    if (!page) {
+        return false;
+    }
+    am->pages[am->page_count++] = page;
+    return true;
+}
+
+static size_t vgc_hash(void *ptr) {
+    return ((uintptr_t)ptr) >> 3;
+}
+
+#if defined(VGC_THREADS)
+/**
+ * A lock stripe of the allocation map.
+ *
+ * Stripe `i` guards every bucket whose index is congruent to `i` modulo
+ * `VGC_MAP_STRIPES`, together with the allocation objects recycled by them
+ * and the count of allocations in those buckets.
+ */
+typedef struct vgc_MapStripe {
+    pthread_mutex_t lock;
+    vgc_Allocation *free_list;
+    size_t size;
+    size_t updates;
+} __attribute__((aligned(VGC_CACHE_LINE_SIZE))) vgc_MapStripe;
+
+/**
+ * Lock the stripe of the bucket that `ptr` hashes to.
+ *
+ * @returns The bucket index, which stays valid until the stripe is unlocked.
+ */
+static size_t vgc_allocation_map_lock(vgc_AllocationMap *am, void *ptr) {
+    for (;;) {
+        size_t capacity = VGC_ATOMIC_LOAD(am->capacity);
+        size_t index = vgc_hash(ptr) % capacity;
+        pthread_mutex_lock(&am->stripes[index % VGC_MAP_STRIPES].lock);
+        /* Rehashing holds all stripes, so the capacity is stable once we hold one */
+        if (am->capacity == capacity) {
+            return index;
+        }
+        pthread_mutex_unlock(&am->stripes[index % VGC_MAP_STRIPES].lock);
+    }
+}
+
+static void vgc_allocation_map_unlock(vgc_AllocationMap *am, size_t index) {
+    pthread_mutex_unlock(&am->stripes[index % VGC_MAP_STRIPES].lock);
+}
+
+/**
+ * Lock all stripes, in order. Must not be called while holding a stripe.
+ */
+static void vgc_allocation_map_lock_all(vgc_AllocationMap *am) {
+    for (size_t i = 0; i < VGC_MAP_STRIPES; ++i) {
+        pthread_mutex_lock(&am->stripes[i].lock);
+    }
+}
+
+static void vgc_allocation_map_unlock_all(vgc_AllocationMap *am) {
+    for (size_t i = VGC_MAP_STRIPES; i > 0; --i) {
+        pthread_mutex_unlock(&am->stripes[i - 1].lock);
+    }
+}
+#endif
+
+/**
+ * Find the free list that recycles the allocation object for `ptr`.
+ *
+ * With `VGC_THREADS` the caller must hold the stripe of `ptr`.
+ */
+static vgc_Allocation ** vgc_allocation_map_free_list(vgc_AllocationMap *am, void *ptr) {
+#if defined(VGC_THREADS)
+    return &am->stripes[(vgc_hash(ptr) % am->capacity) % VGC_MAP_STRIPES].free_list;
+#else
+    (void) ptr;
+    return &am->free_list;
+#endif
+}
+
+/**
+ * Take the next unused slot of the allocation map's pages.
+ *
+ * @returns Pointer to the allocation object in the slot, or `NULL` if out of memory.
+ */
+static vgc_Allocation * vgc_allocation_map_next_slot(vgc_AllocationMap *am) {
+    if (am->slot_count == am->page_count * VGC_PAGE_SLOTS && !vgc_allocation_map_add_page(am)) {
+        return NULL;
+    }
+    size_t slot = am->slot_count++;
+    vgc_Allocation *a = &am->pages[slot / VGC_PAGE_SLOTS][slot % VGC_PAGE_SLOTS];
+    a->slot = (uint32_t) slot;
+    return a;
+}
+
 /**
  * Create a new allocation object.
  *
- * Creates a new allocation object using the system `malloc`.
+ * Takes a recycled allocation object from the allocation map, or the next
+ * unused slot of its pages.
  *
+ * @param[in] am The allocation map that owns the allocation object.
  * @param[in] ptr The pointer to the memory to manage.
  * @param[in] size The size of the memory range pointed to by `ptr`.
  * @param[in] dtor A pointer to a destructor function that should be called
  *                 before freeing the memory pointed to by `ptr`.
- * @returns Pointer to the new allocation instance.
+ * @returns Pointer to the new allocation instance, or `NULL` if out of memory.
  */
-static vgc_Allocation * vgc_allocation_new(void *ptr, size_t size, vgc_Deconstructor dtor) {
-    vgc_Allocation *a = (vgc_Allocation*) malloc(sizeof(vgc_Allocation));
+static vgc_Allocation * vgc_allocation_new(vgc_AllocationMap *am, void *ptr, size_t size, vgc_Deconstructor dtor) {
+    vgc_Allocation **free_list = vgc_allocation_map_free_list(am, ptr);
+    vgc_Allocation *a = *free_list;
+    if (a) {
+        *free_list = a->next;
+    } else {
+        a = vgc_allocation_map_next_slot(am);
+        if (!a) {
+            return NULL;
+        }
+    }
     a->ptr = ptr;
     a->size = size;
     a->tag = VGC_TAG_NONE;
     a->dtor = dtor;
     a->next = NULL;
+    VGC_ATOMIC_OR(am->live[VGC_SLOT_WORD(a->slot)], VGC_SLOT_MASK(a->slot));
+    /* Allocations made by destructors must survive the running sweep */
+    if (am->sweeping) {
+        VGC_ATOMIC_OR(am->marks[VGC_SLOT_WORD(a->slot)], VGC_SLOT_MASK(a->slot));
+    } else {
+        VGC_ATOMIC_AND(am->marks[VGC_SLOT_WORD(a->slot)], ~VGC_SLOT_MASK(a->slot));
+    }
     return a;
 }
 
 /**
  * Delete an allocation object.
  *
- * Deletes the allocation object pointed to by `a`, but does *not*
- * free the memory pointed to by `a->ptr`.
+ * Returns the allocation object pointed to by `a` to the allocation map,
+ * but does *not* free the memory pointed to by `a->ptr`.
  *
+ * @param am The allocation map that owns the allocation object.
  * @param a The allocation object to delete.
  */
-static void vgc_allocation_delete(vgc_Allocation *a) {
-    free(a);
+static void vgc_allocation_delete(vgc_AllocationMap *am, vgc_Allocation *a) {
+    /* The mark bit of a free slot is never read, and reuse rewrites it */
+    VGC_ATOMIC_AND(am->live[VGC_SLOT_WORD(a->slot)], ~VGC_SLOT_MASK(a->slot));
+    vgc_Allocation **free_list = vgc_allocation_map_free_list(am, a->ptr);
+    a->next = *free_list;
+    *free_list = a;
+}
+
+#if defined(VGC_THREADS)
+/**
+ * Move a batch of unused slots to the free list of the stripe of `ptr`.
+ *
+ * Locks all stripes, so it must not be called while holding one.
+ *
+ * @returns `false` if out of memory.
+ */
+static bool vgc_allocation_map_refill(vgc_AllocationMap *am, void *ptr) {
+    vgc_allocation_map_lock_all(am);
+    vgc_Allocation **free_list = vgc_allocation_map_free_list(am, ptr);
+    for (size_t i = 0; i < VGC_STRIPE_BATCH; ++i) {
+        vgc_Allocation *a = vgc_allocation_map_next_slot(am);
+        if (!a) {
+            break;
+        }
+        a->next = *free_list;
+        *free_list = a;
+    }
+    /* A partial batch is fine as long as there is a slot */
+    bool ok = *free_list != NULL;
+    vgc_allocation_map_unlock_all(am);
+    return ok;
+}
+#endif
+
+static bool vgc_allocation_is_marked(vgc_AllocationMap *am, vgc_Allocation *a) {
+    return (am->marks[VGC_SLOT_WORD(a->slot)] & VGC_SLOT_MASK(a->slot)) != 0;
+}
+
+static void vgc_allocation_mark(vgc_AllocationMap *am, vgc_Allocation *a) {
+    am->marks[VGC_SLOT_WORD(a->slot)] |= VGC_SLOT_MASK(a->slot);
+}
+
+/**
+ * Count the allocations in the map.
+ *
+ * With `VGC_THREADS` this sums up the stripes' counters, which is exact as
+ * long as no other thread inserts or removes in the meantime.
+ */
+static size_t vgc_allocation_map_size(vgc_AllocationMap *am) {
+#if defined(VGC_THREADS)
+    size_t size = 0;
+    for (size_t i = 0; i < VGC_MAP_STRIPES; ++i) {
+        size += VGC_ATOMIC_LOAD(am->stripes[i].size);
+    }
+    return size;
+#else
+    return am->size;
+#endif
+}
+
+/**
+ * Adjust the count of allocations in bucket `index` by `delta`.
+ *
+ * With `VGC_THREADS` the caller must hold the stripe of the bucket. Summing
+ * up the stripes is not free, so every stripe only asks for a load check
+ * every `VGC_MAP_STRIPES` updates, which comes to about one check per
+ * `VGC_MAP_STRIPES` inserts and removals overall.
+ *
+ * @returns `true` if the caller should check the load factor.
+ */
+static bool vgc_allocation_map_count(vgc_AllocationMap *am, size_t index, ptrdiff_t delta) {
+#if defined(VGC_THREADS)
+    vgc_MapStripe *stripe = &am->stripes[index % VGC_MAP_STRIPES];
+    /* Only the holder of the stripe writes its counter */
+    VGC_ATOMIC_STORE(stripe->size, stripe->size + (size_t) delta);
+    return ++stripe->updates % VGC_MAP_STRIPES == 0;
+#else
+    (void) index;
+    am->size += (size_t) delta;
+    return true;
+#endif
 }
 
 /**
@@ -156,7 +615,7 @@ static void vgc_allocation_delete(vgc_Allocation *a) {
  * @returns The load factor of the allocation map `am`.
  */
 static double vgc_allocation_map_load_factor(vgc_AllocationMap * am) {
-    return (double) am->size / (double) am->capacity;
+    return (double) vgc_allocation_map_size(am) / (double) VGC_ATOMIC_LOAD(am->capacity);
 }
 
 static vgc_AllocationMap * vgc_allocation_map_new(size_t min_capacity,
@@ -173,97 +632,261 @@ static vgc_AllocationMap * vgc_allocation_map_new(size_t min_capacity,
     am->downsize_factor = downsize_factor;
     am->upsize_factor = upsize_factor;
     am->allocs = (vgc_Allocation**) calloc(am->capacity, sizeof(vgc_Allocation*));
+    am->old_allocs = NULL;
+    am->old_capacity = 0;
+    am->migrate_index = 0;
+    am->pages = NULL;
+    am->page_count = 0;
+    am->page_capacity = 0;
+    am->slot_count = 0;
+#if defined(VGC_THREADS)
+    am->stripes = (vgc_MapStripe *) aligned_alloc(VGC_CACHE_LINE_SIZE, VGC_MAP_STRIPES * sizeof(vgc_MapStripe));
+    for (size_t i = 0; i < VGC_MAP_STRIPES; ++i) {
+        pthread_mutex_init(&am->stripes[i].lock, NULL);
+        am->stripes[i].free_list = NULL;
+        am->stripes[i].size = 0;
+        am->stripes[i].updates = 0;
+    }
+#else
     am->size = 0;
-    LOG_DEBUG("Created allocation map (cap=%lld, siz=%lld)", (uint64_t) am->capacity, (uint64_t) am->size);
+    am->free_list = NULL;
+#endif
+    am->live = NULL;
+    am->marks = NULL;
+    am->sweeping = false;
+    am->min_ptr = UINTPTR_MAX;
+    am->max_ptr = 0;
+    LOG_DEBUG("Created allocation map (cap=%zu, siz=%zu)", am->capacity, vgc_allocation_map_size(am));
     return am;
 }
 
 static void vgc_allocation_map_delete(vgc_AllocationMap * am) {
-    // Iterate over the map
-    LOG_DEBUG("Deleting allocation map (cap=%lld, siz=%lld)",
-              (uint64_t) am->capacity, (uint64_t) am->size);
-    vgc_Allocation *alloc, *tmp;
-    for (size_t i = 0; i < am->capacity; ++i) {
-        if ((alloc = am->allocs[i])) {
-            // Make sure to follow the chain inside a bucket
-            while (alloc) {
-                tmp = alloc;
-                alloc = alloc->next;
-                // free the management structure
-                vgc_allocation_delete(tmp);
-            }
-        }
+    LOG_DEBUG("Deleting allocation map (cap=%zu, siz=%zu)",
+              am->capacity, vgc_allocation_map_size(am));
+    // The allocation objects all live in the pages
+    for (size_t i = 0; i < am->page_count; ++i) {
+        free(am->pages[i]);
     }
+    free(am->pages);
+    free(am->live);
+    free(am->marks);
     free(am->allocs);
+    free(am->old_allocs);
+#if defined(VGC_THREADS)
+    for (size_t i = 0; i < VGC_MAP_STRIPES; ++i) {
+        pthread_mutex_destroy(&am->stripes[i].lock);
+    }
+    free(am->stripes);
+#endif
     free(am);
 }
 
-static size_t vgc_hash(void *ptr) {
-    return ((uintptr_t)ptr) >> 3;
+/**
+ * Move every allocation object of bucket `i` of the old bucket array into
+ * the current one.
+ */
+static void vgc_allocation_map_migrate_bucket(vgc_AllocationMap * am, size_t i) {
+    vgc_Allocation *alloc = am->old_allocs[i];
+    am->old_allocs[i] = NULL;
+    while (alloc) {
+        vgc_Allocation *next_alloc = alloc->next;
+        size_t new_index = vgc_hash(alloc->ptr) % am->capacity;
+        alloc->next = am->allocs[new_index];
+        VGC_ATOMIC_STORE(am->allocs[new_index], alloc);
+        /* The bucket may belong to another stripe now */
+        vgc_allocation_map_count(am, i, -1);
+        vgc_allocation_map_count(am, new_index, 1);
+        alloc = next_alloc;
+    }
+}
+
+/**
+ * Migrate up to `buckets` buckets of the old bucket array, releasing it
+ * once it is empty.
+ */
+static void vgc_allocation_map_migrate(vgc_AllocationMap * am, size_t buckets) {
+    if (!am->old_allocs) {
+        return;
+    }
+    while (buckets-- && am->migrate_index < am->old_capacity) {
+        vgc_allocation_map_migrate_bucket(am, am->migrate_index++);
+    }
+    if (am->migrate_index == am->old_capacity) {
+        LOG_DEBUG("Finished resizing allocation map (cap=%zu)", am->capacity);
+        free(am->old_allocs);
+        am->old_allocs = NULL;
+        am->old_capacity = 0;
+    }
+}
+
+#if !defined(VGC_THREADS)
+/**
+ * Migrate the old bucket that `ptr` hashes to, so that inserts and removals
+ * only have to deal with the current bucket array. With `VGC_THREADS`
+ * resizes migrate everything at once, so there is never an old bucket.
+ */
+static void vgc_allocation_map_migrate_key(vgc_AllocationMap * am, void *ptr) {
+    if (am->old_allocs) {
+        size_t i = vgc_hash(ptr) % am->old_capacity;
+        if (i >= am->migrate_index) {
+            vgc_allocation_map_migrate_bucket(am, i);
+        }
+    }
 }
+#endif
 
 static void vgc_allocation_map_resize(vgc_AllocationMap * am, size_t new_capacity) {
     if (new_capacity <= am->min_capacity) {
         return;
     }
-    // Replaces the existing items array in the hash table
-    // with a resized one and pushes items into the new, correct buckets
-    LOG_DEBUG("Resizing allocation map (cap=%lld, siz=%lld) -> (cap=%lld)",
-              (uint64_t) am->capacity, (uint64_t) am->size, (uint64_t) new_capacity);
+    // Start migrating the existing items into a resized bucket array. Until
+    // all of them are moved, the old array stays in place.
+    LOG_DEBUG("Resizing allocation map (cap=%zu, siz=%zu) -> (cap=%zu)",
+              am->capacity, vgc_allocation_map_size(am), new_capacity);
+    vgc_allocation_map_migrate(am, SIZE_MAX);
     vgc_Allocation **resized_allocs = (vgc_Allocation**) calloc(new_capacity, sizeof(vgc_Allocation*));
-
-    for (size_t i = 0; i < am->capacity; ++i) {
-        vgc_Allocation *alloc = am->allocs[i];
-        while (alloc) {
-            vgc_Allocation *next_alloc = alloc->next;
-            size_t new_index = vgc_hash(alloc->ptr) % new_capacity;
-            alloc->next = resized_allocs[new_index];
-            resized_allocs[new_index] = alloc;
-            alloc = next_alloc;
-        }
+    if (!resized_allocs) {
+        return;
     }
-    free(am->allocs);
-    am->capacity = new_capacity;
+    am->old_allocs = am->allocs;
+    am->old_capacity = am->capacity;
+    am->migrate_index = 0;
     am->allocs = resized_allocs;
-    am->sweep_limit = am->size + am->sweep_factor * (am->capacity - am->size);
+    VGC_ATOMIC_STORE(am->capacity, new_capacity);
+    size_t size = vgc_allocation_map_size(am);
+    am->sweep_limit = size + am->sweep_factor * (am->capacity - size);
 }
 
-static bool vgc_allocation_map_resize_to_fit(vgc_AllocationMap * am) {
+/**
+ * Determine the capacity that brings the load factor back into bounds.
+ *
+ * @returns The new capacity, or 0 if the current one is fine.
+ */
+static size_t vgc_allocation_map_fit_capacity(vgc_AllocationMap * am) {
+    size_t capacity = VGC_ATOMIC_LOAD(am->capacity);
     double load_factor = vgc_allocation_map_load_factor(am);
     if (load_factor > am->upsize_factor) {
         LOG_DEBUG("Load factor %0.3g > %0.3g. Triggering upsize.",
                   load_factor, am->upsize_factor);
-        vgc_allocation_map_resize(am, next_prime(am->capacity * 2));
-        return true;
+        return next_prime(capacity * 2);
     }
     if (load_factor < am->downsize_factor) {
+        /* Never shrink below the minimum capacity */
+        size_t new_capacity = next_prime(capacity / 2);
+        if (new_capacity <= am->min_capacity) {
+            return 0;
+        }
         LOG_DEBUG("Load factor %0.3g < %0.3g. Triggering downsize.",
                   load_factor, am->downsize_factor);
-        vgc_allocation_map_resize(am, next_prime(am->capacity / 2));
-        return true;
+        return new_capacity;
     }
-    return false;
+    return 0;
 }
 
-static vgc_Allocation * vgc_allocation_map_get(vgc_AllocationMap * am, void *ptr) {
+static bool vgc_allocation_map_resize_to_fit(vgc_AllocationMap * am) {
+#if defined(VGC_THREADS)
+    if (!vgc_allocation_map_fit_capacity(am)) {
+        return false;
+    }
+    vgc_allocation_map_lock_all(am);
+    /* Another thread may have resized while we were waiting */
+    size_t capacity = vgc_allocation_map_fit_capacity(am);
+    if (capacity) {
+        vgc_allocation_map_resize(am, capacity);
+        /* Stripes are derived from the current bucket array, migrate right away */
+        vgc_allocation_map_migrate(am, SIZE_MAX);
+    }
+    vgc_allocation_map_unlock_all(am);
+#else
+    /* Let a resize in flight finish first */
+    size_t capacity = am->old_allocs ? 0 : vgc_allocation_map_fit_capacity(am);
+    if (capacity) {
+        vgc_allocation_map_resize(am, capacity);
+    }
+#endif
+    return capacity != 0;
+}
+
+/**
+ * Walk the chain of the bucket that `ptr` hashes to.
+ *
+ * Takes no lock. The marker uses this directly, since nobody inserts or
+ * removes while it runs; with `VGC_THREADS`, everybody else goes through
+ * `vgc_allocation_map_get()`.
+ */
+static vgc_Allocation * vgc_allocation_map_find(vgc_AllocationMap * am, void *ptr) {
     size_t index = vgc_hash(ptr) % am->capacity;
-    vgc_Allocation *cur = am->allocs[index];
+    vgc_Allocation *cur = VGC_ATOMIC_LOAD(am->allocs[index]);
     while(cur) {
         if (cur->ptr == ptr) {
             return cur;
         }
-        cur = cur->next;
+        cur = VGC_ATOMIC_LOAD(cur->next);
+    }
+    /* Migrated buckets are empty, so there is no need to check the index */
+    if (am->old_allocs) {
+        for (cur = am->old_allocs[vgc_hash(ptr) % am->old_capacity]; cur; cur = cur->next) {
+            if (cur->ptr == ptr) {
+                return cur;
+            }
+        }
     }
     return NULL;
 }
 
+static vgc_Allocation * vgc_allocation_map_get(vgc_AllocationMap * am, void *ptr) {
+#if defined(VGC_THREADS)
+    size_t index = vgc_allocation_map_lock(am, ptr);
+    vgc_Allocation *alloc = vgc_allocation_map_find(am, ptr);
+    vgc_allocation_map_unlock(am, index);
+    return alloc;
+#else
+    return vgc_allocation_map_find(am, ptr);
+#endif
+}
+
+/**
+ * Widen the heap bounds that the scan kernels filter candidates against.
+ */
+static void vgc_allocation_map_widen(vgc_AllocationMap * am, uintptr_t p) {
+#if defined(VGC_THREADS)
+    uintptr_t cur = __atomic_load_n(&am->min_ptr, __ATOMIC_RELAXED);
+    while (p < cur && !__atomic_compare_exchange_n(&am->min_ptr, &cur, p, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    cur = __atomic_load_n(&am->max_ptr, __ATOMIC_RELAXED);
+    while (p > cur && !__atomic_compare_exchange_n(&am->max_ptr, &cur, p, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+#else
+    if (p < am->min_ptr) am->min_ptr = p;
+    if (p > am->max_ptr) am->max_ptr = p;
+#endif
+}
+
 static vgc_Allocation * vgc_allocation_map_put(vgc_AllocationMap * am,
         void *ptr,
         size_t size,
         vgc_Deconstructor dtor) {
+#if defined(VGC_THREADS)
+    size_t index = vgc_allocation_map_lock(am, ptr);
+    /* Never grow the pages while holding a stripe */
+    while (!*vgc_allocation_map_free_list(am, ptr)) {
+        vgc_allocation_map_unlock(am, index);
+        if (!vgc_allocation_map_refill(am, ptr)) {
+            return NULL;
+        }
+        index = vgc_allocation_map_lock(am, ptr);
+    }
+#else
+    vgc_allocation_map_migrate(am, VGC_REHASH_STEP);
+    vgc_allocation_map_migrate_key(am, ptr);
     size_t index = vgc_hash(ptr) % am->capacity;
-    LOG_DEBUG("PUT request for allocation ix=%lld", (uint64_t) index);
-    vgc_Allocation *alloc = vgc_allocation_new(ptr, size, dtor);
+#endif
+    LOG_DEBUG("PUT request for allocation ix=%zu", index);
+    vgc_Allocation *alloc = vgc_allocation_new(am, ptr, size, dtor);
+    if (!alloc) {
+#if defined(VGC_THREADS)
+        vgc_allocation_map_unlock(am, index);
+#endif
+        return NULL;
+    }
     vgc_Allocation *cur = am->allocs[index];
     vgc_Allocation *prev = NULL;
     /* Upsert if ptr is already known (e.g. dtor update). */
@@ -273,13 +896,16 @@ static vgc_Allocation * vgc_allocation_map_put(vgc_AllocationMap * am,
             alloc->next = cur->next;
             if (!prev) {
                 // position 0
-                am->allocs[index] = alloc;
+                VGC_ATOMIC_STORE(am->allocs[index], alloc);
             } else {
                 // in the list
-                prev->next = alloc;
+                VGC_ATOMIC_STORE(prev->next, alloc);
             }
-            vgc_allocation_delete(cur);
-            LOG_DEBUG("AllocationMap Upsert at ix=%lld", (uint64_t) index);
+            vgc_allocation_delete(am, cur);
+            LOG_DEBUG("AllocationMap Upsert at ix=%zu", index);
+#if defined(VGC_THREADS)
+            vgc_allocation_map_unlock(am, index);
+#endif
             return alloc;
 
         }
@@ -289,12 +915,16 @@ static vgc_Allocation * vgc_allocation_map_put(vgc_AllocationMap * am,
     /* Insert at the front of the separate chaining list */
     cur = am->allocs[index];
     alloc->next = cur;
-    am->allocs[index] = alloc;
-    am->size++;
-    LOG_DEBUG("AllocationMap insert at ix=%lld", (uint64_t) index);
-    void *p = alloc->ptr;
-    if (vgc_allocation_map_resize_to_fit(am)) {
-        alloc = vgc_allocation_map_get(am, p);
+    VGC_ATOMIC_STORE(am->allocs[index], alloc);
+    bool check = vgc_allocation_map_count(am, index, 1);
+    vgc_allocation_map_widen(am, (uintptr_t) ptr);
+    LOG_DEBUG("AllocationMap insert at ix=%zu", index);
+#if defined(VGC_THREADS)
+    vgc_allocation_map_unlock(am, index);
+#endif
+    /* Allocation objects never move, rehashing only relinks them */
+    if (check) {
+        vgc_allocation_map_resize_to_fit(am);
     }
     return alloc;
 }
@@ -303,351 +933,3229 @@ static void vgc_allocation_map_remove(vgc_AllocationMap * am,
                                      void *ptr,
                                      bool allow_resize) {
     // ignores unknown keys
+#if defined(VGC_THREADS)
+    size_t index = vgc_allocation_map_lock(am, ptr);
+#else
+    vgc_allocation_map_migrate(am, VGC_REHASH_STEP);
+    vgc_allocation_map_migrate_key(am, ptr);
     size_t index = vgc_hash(ptr) % am->capacity;
+#endif
     vgc_Allocation *cur = am->allocs[index];
     vgc_Allocation *prev = NULL;
     vgc_Allocation *next;
+    bool check = false;
     while(cur != NULL) {
         next = cur->next;
         if (cur->ptr == ptr) {
             // found it
             if (!prev) {
                 // first item in list
-                am->allocs[index] = cur->next;
+                VGC_ATOMIC_STORE(am->allocs[index], cur->next);
             } else {
                 // not the first item in the list
-                prev->next = cur->next;
+                VGC_ATOMIC_STORE(prev->next, cur->next);
             }
-            vgc_allocation_delete(cur);
-            am->size--;
+            vgc_allocation_delete(am, cur);
+            check |= vgc_allocation_map_count(am, index, -1);
         } else {
             // move on
             prev = cur;
         }
         cur = next;
     }
-    if (allow_resize) {
+#if defined(VGC_THREADS)
+    vgc_allocation_map_unlock(am, index);
+#endif
+    if (allow_resize && check) {
         vgc_allocation_map_resize_to_fit(am);
     }
 }
 
-static void * vgc_mcalloc(size_t count, size_t size) {
-    if (!count) return malloc(size);
-    return calloc(count, size);
-}
-
-static bool vgc_needs_sweep(vgc_GC *gc) {
-    return gc->allocs->size > gc->allocs->sweep_limit;
+/**
+ * Rekey the allocation object of `from` to `to`, after `realloc()` moved the
+ * block.
+ *
+ * The allocation object keeps its slot, tag, destructor and mark bit and is
+ * only relinked into the bucket of `to`, so a moving reallocation takes no new
+ * metadata and leaves the map's size (and the resize check) alone.
+ *
+ * @returns The allocation object, or `NULL` if `from` is unknown.
+ */
+static vgc_Allocation * vgc_allocation_map_move(vgc_AllocationMap * am,
+                                                void *from,
+                                                void *to,
+                                                size_t size) {
+#if defined(VGC_THREADS)
+    /* Take both stripes in the same order as vgc_allocation_map_lock_all() */
+    size_t from_stripe, to_stripe;
+    for (;;) {
+        size_t capacity = VGC_ATOMIC_LOAD(am->capacity);
+        from_stripe = (vgc_hash(from) % capacity) % VGC_MAP_STRIPES;
+        to_stripe = (vgc_hash(to) % capacity) % VGC_MAP_STRIPES;
+        pthread_mutex_lock(&am->stripes[from_stripe < to_stripe ? from_stripe : to_stripe].lock);
+        if (from_stripe != to_stripe) {
+            pthread_mutex_lock(&am->stripes[from_stripe < to_stripe ? to_stripe : from_stripe].lock);
+        }
+        if (am->capacity == capacity) {
+            break;
+        }
+        if (from_stripe != to_stripe) {
+            pthread_mutex_unlock(&am->stripes[to_stripe].lock);
+        }
+        pthread_mutex_unlock(&am->stripes[from_stripe].lock);
+    }
+#else
+    vgc_allocation_map_migrate(am, VGC_REHASH_STEP);
+    vgc_allocation_map_migrate_key(am, from);
+    vgc_allocation_map_migrate_key(am, to);
+#endif
+    size_t index = vgc_hash(from) % am->capacity;
+    vgc_Allocation *cur = am->allocs[index];
+    vgc_Allocation *prev = NULL;
+    while (cur && cur->ptr != from) {
+        prev = cur;
+        cur = cur->next;
+    }
+    if (cur) {
+        if (!prev) {
+            VGC_ATOMIC_STORE(am->allocs[index], cur->next);
+        } else {
+            VGC_ATOMIC_STORE(prev->next, cur->next);
+        }
+        cur->ptr = to;
+        cur->size = size;
+        vgc_allocation_map_count(am, index, -1);
+        index = vgc_hash(to) % am->capacity;
+        cur->next = am->allocs[index];
+        VGC_ATOMIC_STORE(am->allocs[index], cur);
+        vgc_allocation_map_count(am, index, 1);
+        vgc_allocation_map_widen(am, (uintptr_t) to);
+    }
+#if defined(VGC_THREADS)
+    if (from_stripe != to_stripe) {
+        pthread_mutex_unlock(&am->stripes[to_stripe].lock);
+    }
+    pthread_mutex_unlock(&am->stripes[from_stripe].lock);
+#endif
+    return cur;
+}
+
+/**
+ * Create a new span.
+ *
+ * The span header, the object start bitmap and the object memory are
+ * carved out of a single system allocation.
+ *
+ * @param capacity The number of bytes available for objects.
+ * @returns Pointer to the new span, or `NULL` if out of memory.
+ */
+static vgc_Span * vgc_span_new(size_t capacity) {
+    capacity = VGC_ALIGN_UP(capacity, VGC_SPAN_GRANULE);
+    size_t words = (capacity / VGC_SPAN_GRANULE + 63) / 64;
+    size_t header = VGC_ALIGN_UP(sizeof(vgc_Span) + words * sizeof(uint64_t), VGC_SPAN_GRANULE);
+    char *block = (char *) malloc(header + capacity);
+    if (!block) {
+        return NULL;
+    }
+    vgc_Span *span = (vgc_Span *) block;
+    span->next = NULL;
+    span->data = block + header;
+    span->capacity = capacity;
+    span->used = 0;
+    span->refs = 0;
+    span->owned = true;
+    span->registered = 0;
+    span->starts = (uint64_t *) (block + sizeof(vgc_Span));
+    memset(span->starts, 0, words * sizeof(uint64_t));
+    LOG_DEBUG("Created span %p (cap=%zu)", (void *) span, capacity);
+    return span;
+}
+
+/**
+ * Add a span to the address index of a region.
+ *
+ * @returns `false` if out of memory.
+ */
+static bool vgc_region_index_add(vgc_Region *region, vgc_Span *span) {
+    if (region->span_count == region->index_capacity) {
+        size_t capacity = region->index_capacity ? 2 * region->index_capacity : 8;
+        vgc_Span **index = (vgc_Span **) realloc(region->index, capacity * sizeof(vgc_Span *));
+        if (!index) {
+            return false;
+        }
+        region->index = index;
+        region->index_capacity = capacity;
+    }
+    size_t i = region->span_count;
+    while (i > 0 && region->index[i - 1]->data > span->data) {
+        region->index[i] = region->index[i - 1];
+        --i;
+    }
+    region->index[i] = span;
+    region->span_count++;
+    return true;
+}
+
+/**
+ * Find the span of a region whose object memory contains `ptr`.
+ */
+static vgc_Span * vgc_region_index_find(const vgc_Region *region, const char *ptr) {
+    size_t lo = 0;
+    size_t hi = region->span_count;
+    /* Find the first span that starts past `ptr` */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (region->index[mid]->data <= ptr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (!lo) {
+        return NULL;
+    }
+    vgc_Span *span = region->index[lo - 1];
+    return ptr < span->data + span->used ? span : NULL;
 }
 
-static void * vgc_allocate(vgc_GC *gc, size_t count, size_t size, vgc_Deconstructor dtor) {
-    /* Allocation logic that generalizes over malloc/calloc. */
+/**
+ * Look up the object of a region that `ptr` points to.
+ *
+ * Only pointers to the first byte of an object are accepted.
+ */
+static vgc_SpanObject * vgc_region_object_get(const vgc_Region *region, void *ptr) {
+    vgc_Span *span = vgc_region_index_find(region, (char *) ptr);
+    if (!span) {
+        return NULL;
+    }
+    size_t offset = (size_t) ((char *) ptr - span->data);
+    if (offset % VGC_SPAN_GRANULE) {
+        return NULL;
+    }
+    size_t granule = offset / VGC_SPAN_GRANULE;
+    if (span->starts[granule / 64] & ((uint64_t) 1 << (granule % 64))) {
+        return VGC_SPAN_OBJECT_HEADER(ptr);
+    }
+    return NULL;
+}
 
-    /* Check if we reached the high-water mark and need to clean up */
-    if (vgc_needs_sweep(gc) && !gc->disabled) {
-        size_t freed_mem = vgc_collect(gc);
-        LOG_DEBUG("Garbage collection cleaned up %llu bytes.", freed_mem);
+/**
+ * Look up the span object that `ptr` points to.
+ *
+ * Only pointers to the first byte of a live object in one of the active
+ * regions are accepted.
+ */
+static vgc_SpanObject * vgc_span_object_get(vgc_GC *gc, void *ptr) {
+    for (vgc_Region *region = gc->region; region; region = region->parent) {
+        vgc_SpanObject *object = vgc_region_object_get(region, ptr);
+        if (object) {
+            return object;
+        }
     }
-    /* With cleanup out of the way, attempt to allocate memory */
-    void *ptr = vgc_mcalloc(count, size);
+    return NULL;
+}
+
+/**
+ * Drop the reference a promoted object holds on its span.
+ *
+ * The span is freed once its region has ended and the last promoted
+ * object in it has been collected. The caller runs the destructor.
+ */
+static void vgc_span_release(void *ptr) {
+    vgc_SpanObject *object = VGC_SPAN_OBJECT_HEADER(ptr);
+    vgc_Span *span = object->span;
+    object->promoted = false;
+    object->dtor = NULL;
+    if (--span->refs == 0 && !span->owned) {
+        LOG_DEBUG("Releasing span %p", (void *) span);
+        free(span);
+    }
+}
+
+/**
+ * Release the memory of a managed allocation without running its destructor.
+ */
+static void vgc_release(void *ptr, char tag) {
+    if (tag & VGC_TAG_SPAN) {
+        vgc_span_release(ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+/**
+ * Register the objects bumped from the allocation span since the last
+ * flush in the allocation map.
+ *
+ * Registered objects are promoted span objects like any other: they keep
+ * the span alive until the last of them has been collected.
+ *
+ * @returns `false` if out of memory.
+ */
+static bool vgc_span_flush(vgc_GC *gc) {
+    vgc_Span *span = gc->span;
+    if (!span || span->registered == span->used) {
+        return true;
+    }
+    size_t granule = span->registered / VGC_SPAN_GRANULE;
+    size_t last = span->used / VGC_SPAN_GRANULE;
+    while (granule < last) {
+        uint64_t bits = span->starts[granule / 64] >> (granule % 64);
+        if (!bits) {
+            granule = (granule / 64 + 1) * 64;
+            continue;
+        }
+        granule += vgc_ctz64(bits);
+        if (granule >= last) {
+            break;
+        }
+        char *ptr = span->data + granule * VGC_SPAN_GRANULE;
+        vgc_SpanObject *object = VGC_SPAN_OBJECT_HEADER(ptr);
+        vgc_Allocation *alloc = vgc_allocation_map_put(gc->allocs, ptr, object->size, object->dtor);
+        if (!alloc) {
+            LOG_CRITICAL("Failed to register span object %p", (void *) ptr);
+            span->registered = (size_t) (ptr - span->data);
+            return false;
+        }
+        alloc->tag |= VGC_TAG_SPAN;
+        object->promoted = true;
+        span->refs++;
+        granule++;
+    }
+    span->registered = span->used;
+    return true;
+}
+
+/**
+ * Flush the allocation span and let go of it.
+ *
+ * The span is freed together with the last of its objects.
+ *
+ * @returns `false` if out of memory; the span is kept in that case.
+ */
+static bool vgc_span_retire(vgc_GC *gc) {
+    vgc_Span *span = gc->span;
+    if (!span) {
+        return true;
+    }
+    if (!vgc_span_flush(gc)) {
+        return false;
+    }
+    gc->span = NULL;
+    span->owned = false;
+    if (!span->refs) {
+        free(span);
+    }
+    return true;
+}
+
+/**
+ * Look up the allocation object of `ptr`, registering the allocation span
+ * first if `ptr` was bumped from it and is not in the allocation map yet.
+ */
+static vgc_Allocation * vgc_allocation_get(vgc_GC *gc, void *ptr) {
+    vgc_Span *span = gc->span;
+    if (span && (char *) ptr >= span->data + span->registered && (char *) ptr < span->data + span->used) {
+        vgc_span_flush(gc);
+    }
+    return vgc_allocation_map_get(gc->allocs, ptr);
+}
+
+static void * vgc_region_allocate(vgc_Region *region, size_t count, size_t size, size_t alignment,
+                                  vgc_Deconstructor dtor) {
     size_t alloc_size = count ? count * size : size;
-    /* If allocation fails, force an out-of-policy run to free some memory and try again. */
-    if (!ptr && !gc->disabled && (errno == EAGAIN || errno == ENOMEM)) {
-        vgc_collect(gc);
-        ptr = vgc_mcalloc(count, size);
+    if (alignment < VGC_SPAN_GRANULE) {
+        alignment = VGC_SPAN_GRANULE;
     }
-    /* Start managing the memory we received from the system */
-    if (ptr) {
-        LOG_DEBUG("Allocated %zu bytes at %p", alloc_size, (void *) ptr);
-        vgc_Allocation *alloc = vgc_allocation_map_put(gc->allocs, ptr, alloc_size, dtor);
-        /* Deal with metadata allocation failure */
-        if (alloc) {
-            LOG_DEBUG("Managing %zu bytes at %p", alloc_size, (void *) alloc->ptr);
-            ptr = alloc->ptr;
+    vgc_SpanObject *object = region->spans ? vgc_span_bump(region->spans, alloc_size, alignment) : NULL;
+    if (!object) {
+        size_t needed = sizeof(vgc_SpanObject) + alignment + alloc_size;
+        bool dedicated = needed > VGC_SPAN_SIZE / 4;
+        vgc_Span *span = vgc_span_new(dedicated ? needed : VGC_SPAN_SIZE);
+        if (!span) {
+            return NULL;
+        }
+        if (!vgc_region_index_add(region, span)) {
+            free(span);
+            return NULL;
+        }
+        if (dedicated && region->spans) {
+            /* Keep bumping from the current span */
+            span->next = region->spans->next;
+            region->spans->next = span;
         } else {
-            /* We failed to allocate the metadata, fail cleanly. */
-            free(ptr);
-            ptr = NULL;
+            span->next = region->spans;
+            region->spans = span;
         }
+        object = vgc_span_bump(span, alloc_size, alignment);
+    }
+    if (dtor) {
+        object->dtor = dtor;
+        object->next = region->finalizers;
+        region->finalizers = object;
+    }
+    void *ptr = VGC_SPAN_OBJECT_PTR(object);
+    if (count) {
+        memset(ptr, 0, alloc_size);
     }
     return ptr;
 }
 
-static void vgc_make_root(vgc_GC *gc, void * const ptr) {
-    vgc_Allocation *alloc = vgc_allocation_map_get(gc->allocs, ptr);
-    if (alloc) {
-        alloc->tag |= VGC_TAG_ROOT;
+/**
+ * Promote a region object into the allocation map and queue it for scanning.
+ *
+ * Marking is not in progress while objects are promoted, so promotion
+ * borrows the gray stack of the mark queue as its worklist. That keeps long
+ * chains of region objects from growing the C stack.
+ *
+ * @returns `false` if out of memory.
+ */
+static bool vgc_region_promote_object(vgc_GC *gc, vgc_SpanObject *object) {
+    vgc_MarkQueue *mq = gc->mark_queue;
+    if (mq->gray_size == mq->gray_capacity) {
+        size_t capacity = mq->gray_capacity ? 2 * mq->gray_capacity : 256;
+        vgc_Allocation **gray = (vgc_Allocation **) realloc(mq->gray, capacity * sizeof(vgc_Allocation *));
+        if (!gray) {
+            LOG_CRITICAL("Failed to queue region object %p", VGC_SPAN_OBJECT_PTR(object));
+            return false;
+        }
+        mq->gray = gray;
+        mq->gray_capacity = capacity;
     }
+    void *ptr = VGC_SPAN_OBJECT_PTR(object);
+    LOG_DEBUG("Promoting region object %p (%zu bytes)", ptr, object->size);
+    vgc_Allocation *alloc = vgc_allocation_map_put(gc->allocs, ptr, object->size, object->dtor);
+    if (!alloc) {
+        LOG_CRITICAL("Failed to promote region object %p", ptr);
+        return false;
+    }
+    alloc->tag |= VGC_TAG_SPAN;
+    object->promoted = true;
+    object->span->refs++;
+    mq->gray[mq->gray_size++] = alloc;
+    return true;
 }
 
-void * vgc_malloc(vgc_GC *gc, size_t const size) {
-    return vgc_malloc_ext(gc, size, NULL);
+/**
+ * Promote the region objects referenced from the words in a memory range.
+ *
+ * Only objects of `region` are considered, or of any active region if
+ * `region` is `NULL`. The promoted objects are queued, not scanned.
+ *
+ * @returns `false` if out of memory.
+ */
+static bool vgc_region_promote_words(vgc_GC *gc, const vgc_Region *region, void *begin, void *end) {
+    if ((size_t) ((char *) end - (char *) begin) < VGC_PTRSIZE) {
+        return true;
+    }
+    for (char *p = (char *) begin; p <= (char *) end - VGC_PTRSIZE; p += VGC_PTRSIZE) {
+        void *candidate = *(void **) p;
+        vgc_SpanObject *child = region ? vgc_region_object_get(region, candidate) : vgc_span_object_get(gc, candidate);
+        if (child && !child->promoted && !vgc_region_promote_object(gc, child)) {
+            return false;
+        }
+    }
+    return true;
 }
 
-vgc_Array * vgc_create_array(vgc_GC *gc, size_t tsize, size_t count) {
-    return vgc_create_array_ext(gc, tsize, count, NULL);
+/**
+ * Scan queued promoted objects until the worklist is empty, promoting every
+ * region object they reference.
+ *
+ * @returns `false` if out of memory.
+ */
+static bool vgc_region_promote_drain(vgc_GC *gc) {
+    vgc_MarkQueue *mq = gc->mark_queue;
+    while (mq->gray_size) {
+        vgc_Allocation *alloc = mq->gray[--mq->gray_size];
+        if (!vgc_region_promote_words(gc, NULL, alloc->ptr, (char *) alloc->ptr + alloc->size)) {
+            mq->gray_size = 0;
+            return false;
+        }
+    }
+    return true;
 }
 
-vgc_Array * vgc_create_array_ext(vgc_GC *gc, size_t tsize, size_t count, vgc_Deconstructor dtor) {
-    // Allocate the memory required by the array.
-    vgc_Array *array = vgcx_new_ext(gc, vgc_Array, dtor);
+/**
+ * Promote every region object reachable from the words in a memory range.
+ *
+ * The first hop only considers objects of `region`, or of any active region
+ * if `region` is `NULL`.
+ *
+ * @returns `false` if out of memory.
+ */
+static bool vgc_region_promote_range(vgc_GC *gc, const vgc_Region *region, void *begin, void *end) {
+    if (!vgc_region_promote_words(gc, region, begin, end)) {
+        gc->mark_queue->gray_size = 0;
+        return false;
+    }
+    return vgc_region_promote_drain(gc);
+}
 
-    // Allocate an underlying buffer for the array to store its values.
-    vgc_Buffer *buffer = vgc_create_buffer(gc, count * tsize);
+/**
+ * Promote every region object referenced from a root.
+ *
+ * Objects on the stack and in unrooted heap allocations are not considered;
+ * those have to be promoted explicitly.
+ *
+ * @returns `false` if out of memory.
+ */
+static bool vgc_region_promote_roots(vgc_GC *gc) {
+    vgc_RootSet *rs = gc->roots;
+    for (size_t i = 0; i < rs->size; ++i) {
+        vgc_Allocation *alloc = vgc_allocation_map_get(gc->allocs, rs->roots[i]);
+        if (alloc && !(alloc->tag & VGC_TAG_NOSCAN) &&
+            !vgc_region_promote_range(gc, NULL, alloc->ptr, (char *) alloc->ptr + alloc->size)) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < rs->range_count; ++i) {
+        if (!vgc_region_promote_range(gc, NULL, rs->ranges[i].begin, rs->ranges[i].end)) {
+            return false;
+        }
+    }
+    for (vgc_ShadowRoot *root = rs->shadow; root; root = root->next) {
+        vgc_SpanObject *object = vgc_span_object_get(gc, root->ptr);
+        if (object && !object->promoted &&
+            !(vgc_region_promote_object(gc, object) && vgc_region_promote_drain(gc))) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    // Set the underlying buffer that the array represents.
-    vgc__array_set_buffer(array, buffer);
+static vgc_RootSet * vgc_root_set_new(void) {
+    vgc_RootSet *rs = (vgc_RootSet *) malloc(sizeof(vgc_RootSet));
+    rs->roots = NULL;
+    rs->size = 0;
+    rs->capacity = 0;
+    rs->ranges = NULL;
+    rs->range_count = 0;
+    rs->range_capacity = 0;
+    rs->shadow = NULL;
+    return rs;
+}
 
-    // Set the number of slots the array contains.
-    vgc__array_set_slot_count(array, count);
+static void vgc_root_set_delete(vgc_RootSet *rs) {
+    free(rs->roots);
+    free(rs->ranges);
+    free(rs);
+}
+
+static bool vgc_root_set_add(vgc_RootSet *rs, void *ptr) {
+    if (rs->size == rs->capacity) {
+        size_t capacity = rs->capacity ? 2 * rs->capacity : 16;
+        void **roots = (void **) realloc(rs->roots, capacity * sizeof(void *));
+        if (!roots) {
+            return false;
+        }
+        rs->roots = roots;
+        rs->capacity = capacity;
+    }
+    rs->roots[rs->size++] = ptr;
+    return true;
+}
+
+static void vgc_root_set_remove(vgc_RootSet *rs, void *ptr) {
+    for (size_t i = 0; i < rs->size; ++i) {
+        if (rs->roots[i] == ptr) {
+            /* Order does not matter, fill the gap with the last root */
+            rs->roots[i] = rs->roots[--rs->size];
+            return;
+        }
+    }
+}
+
+static void vgc_root_set_replace(vgc_RootSet *rs, void *ptr, void *new_ptr) {
+    for (size_t i = 0; i < rs->size; ++i) {
+        if (rs->roots[i] == ptr) {
+            rs->roots[i] = new_ptr;
+            return;
+        }
+    }
+}
+
+static vgc_MarkQueue * vgc_mark_queue_new(void) {
+    vgc_MarkQueue *mq = (vgc_MarkQueue *) malloc(sizeof(vgc_MarkQueue));
+    mq->head = 0;
+    mq->count = 0;
+    mq->gray = NULL;
+    mq->gray_size = 0;
+    mq->gray_capacity = 0;
+    return mq;
+}
+
+static void vgc_mark_queue_delete(vgc_MarkQueue *mq) {
+    free(mq->gray);
+    free(mq);
+}
+
+static void * vgc_mcalloc(size_t count, size_t size, size_t alignment) {
+    if (alignment) {
+        size_t alloc_size = count ? count * size : size;
+#if defined(_MSC_VER)
+        /* _aligned_malloc() memory cannot be released with free(), so settle for malloc(). */
+        void *ptr = malloc(alloc_size);
+#else
+        void *ptr = aligned_alloc(alignment, VGC_ALIGN_UP(alloc_size, alignment));
+#endif
+        if (ptr && count) memset(ptr, 0, alloc_size);
+        return ptr;
+    }
+    if (!count) return malloc(size);
+    return calloc(count, size);
+}
+
+#if !defined(VGC_THREADS)
+static bool vgc_needs_sweep(vgc_GC *gc) {
+    return gc->allocs->size > gc->allocs->sweep_limit;
+}
+#endif
+
+static void vgc_dirty_touch(vgc_GC *gc, void *ptr, size_t size);
+
+static vgc_Pool * vgc_pool_get(vgc_GC *gc, size_t size) {
+    for (size_t i = 0; i < gc->pool_count; ++i) {
+        if (gc->pools[i].size == size) {
+            return &gc->pools[i];
+        }
+    }
+    return NULL;
+}
+
+bool vgc_add_pool(vgc_GC *gc, size_t size, size_t max_bytes) {
+#if defined(VGC_THREADS)
+    /* Pools are not synchronized */
+    (void) gc;
+    (void) size;
+    (void) max_bytes;
+    return false;
+#else
+    if (size < sizeof(void *)) {
+        errno = EINVAL;
+        return false;
+    }
+    /* Span memory cannot be recycled, so pooled collectors do without */
+    if (!vgc_span_retire(gc)) {
+        return false;
+    }
+    vgc_Pool *pool = vgc_pool_get(gc, size);
+    if (!pool) {
+        pool = (vgc_Pool *) realloc(gc->pools, (gc->pool_count + 1) * sizeof(vgc_Pool));
+        if (!pool) {
+            return false;
+        }
+        gc->pools = pool;
+        pool = &gc->pools[gc->pool_count++];
+        pool->size = size;
+        pool->count = 0;
+        pool->free_list = NULL;
+    }
+    pool->max_count = max_bytes / size;
+    /* Trim the pool down to its new limit */
+    while (pool->count > pool->max_count) {
+        void *block = pool->free_list;
+        pool->free_list = *(void **) block;
+        pool->count--;
+        free(block);
+    }
+    return true;
+#endif
+}
+
+/*
+ * Take a block from the pool for `size`, if any.
+ */
+static void * vgc_pool_take(vgc_GC *gc, size_t size, bool zero) {
+    vgc_Pool *pool = vgc_pool_get(gc, size);
+    if (!pool || !pool->free_list) {
+        return NULL;
+    }
+    void *block = pool->free_list;
+    pool->free_list = *(void **) block;
+    pool->count--;
+    if (zero) {
+        memset(block, 0, size);
+    }
+    return block;
+}
+
+/*
+ * Release the memory of a dead allocation, keeping it for reuse if its
+ * size is pooled and the pool has room.
+ */
+static void vgc_recycle(vgc_GC *gc, void *ptr, char tag, size_t size) {
+    vgc_Pool *pool = gc->pool_count && !(tag & VGC_TAG_SPAN) ? vgc_pool_get(gc, size) : NULL;
+    if (pool && pool->count < pool->max_count) {
+        *(void **) ptr = pool->free_list;
+        pool->free_list = ptr;
+        pool->count++;
+        return;
+    }
+    vgc_release(ptr, tag);
+}
+
+static void vgc_pool_delete_all(vgc_GC *gc) {
+    for (size_t i = 0; i < gc->pool_count; ++i) {
+        while (gc->pools[i].free_list) {
+            void *block = gc->pools[i].free_list;
+            gc->pools[i].free_list = *(void **) block;
+            free(block);
+        }
+    }
+    free(gc->pools);
+    gc->pools = NULL;
+    gc->pool_count = 0;
+}
+
+/*
+ * Collect if the allocation map has reached its high-water mark, or free
+ * what a snapshot collection in flight has reported so far.
+ */
+static void vgc_collect_if_needed(vgc_GC *gc) {
+    /*
+     * A collection only scans the stack of the calling thread, so with
+     * VGC_THREADS it must be run explicitly while the other threads are
+     * quiescent instead of being triggered by whichever thread allocates.
+     */
+#if defined(VGC_THREADS)
+    (void) gc;
+#else
+    if (gc->snapshot && gc->snapshot_mode) {
+        /* Free what the marker child has reported so far */
+        if (vgc_snapshot_poll(gc)) {
+            size_t freed_mem = vgc_snapshot_end(gc);
+            LOG_DEBUG("Snapshot collection cleaned up %zu bytes.", freed_mem);
+        }
+    } else if (vgc_needs_sweep(gc) && !gc->disabled) {
+        /* Check if we reached the high-water mark and need to clean up */
+        if (gc->snapshot_mode && vgc_snapshot_begin(gc)) {
+            LOG_DEBUG("Started snapshot collection%s", "");
+        } else {
+            if (gc->recorder) {
+                gc->recorder->automatic = true;
+            }
+            size_t freed_mem = vgc_collect(gc);
+            LOG_DEBUG("Garbage collection cleaned up %zu bytes.", freed_mem);
+        }
+    }
+#endif
+}
+
+/*
+ * The slow path of `vgc_malloc_fast()` outside regions: bump-allocate from
+ * the allocation span, or retire it once it is exhausted and start a new
+ * one. Only then are its objects registered and a collection considered.
+ *
+ * Returns `NULL` for allocations that go through `vgc_allocate()` instead:
+ * with VGC_THREADS, whose collectors are shared between threads, for large
+ * objects, and while pools, recording or dirty tracking need to see every
+ * allocation on its own.
+ */
+static void * vgc_span_allocate(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
+#if defined(VGC_THREADS)
+    (void) gc;
+    (void) size;
+    (void) dtor;
+    return NULL;
+#else
+    if (gc->region || gc->pool_count || gc->recorder || gc->dirty || size > VGC_SPAN_SIZE / 4) {
+        return NULL;
+    }
+    vgc_SpanObject *object = gc->span ? vgc_span_bump(gc->span, size, VGC_SPAN_GRANULE) : NULL;
+    if (!object) {
+        if (!vgc_span_retire(gc)) {
+            return NULL;
+        }
+        vgc_collect_if_needed(gc);
+        vgc_Span *span = vgc_span_new(VGC_SPAN_SIZE);
+        if (!span) {
+            return NULL;
+        }
+        /* Stale pointers in recycled memory would keep garbage alive */
+        memset(span->data, 0, span->capacity);
+        LOG_DEBUG("Started allocation span %p", (void *) span);
+        gc->span = span;
+        object = vgc_span_bump(span, size, VGC_SPAN_GRANULE);
+    }
+    object->dtor = dtor;
+    return VGC_SPAN_OBJECT_PTR(object);
+#endif
+}
+
+static void * vgc_allocate(vgc_GC *gc, size_t count, size_t size, size_t alignment, vgc_Deconstructor dtor) {
+    /* Allocation logic that generalizes over malloc/calloc/aligned_alloc. */
+
+    /* Pools and regions see the size before calloc() could check it */
+    if (count && size && count > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Inside a region, bump-allocate without touching the allocation map */
+    if (gc->region) {
+        return vgc_region_allocate(gc->region, count, size, alignment, dtor);
+    }
+
+    vgc_collect_if_needed(gc);
+    /* With cleanup out of the way, attempt to allocate memory */
+    size_t alloc_size = count ? count * size : size;
+    void *ptr = gc->pool_count && !alignment ? vgc_pool_take(gc, alloc_size, count != 0) : NULL;
+    if (!ptr) {
+        ptr = vgc_mcalloc(count, size, alignment);
+    }
+#if !defined(VGC_THREADS)
+    /* If allocation fails, force an out-of-policy run to free some memory and try again. */
+    if (!ptr && !gc->disabled && (errno == EAGAIN || errno == ENOMEM)) {
+        vgc_collect(gc);
+        ptr = vgc_mcalloc(count, size, alignment);
+    }
+#endif
+    /* Start managing the memory we received from the system */
+    if (ptr) {
+        LOG_DEBUG("Allocated %zu bytes at %p", alloc_size, (void *) ptr);
+        vgc_Allocation *alloc = vgc_allocation_map_put(gc->allocs, ptr, alloc_size, dtor);
+        /* Deal with metadata allocation failure */
+        if (alloc) {
+            LOG_DEBUG("Managing %zu bytes at %p", alloc_size, (void *) alloc->ptr);
+            ptr = alloc->ptr;
+            if (gc->recorder) {
+                vgc_record(gc, count ? VGC_RECORD_CALLOC : VGC_RECORD_MALLOC, dtor ? VGC_RECORD_DTOR : 0,
+                           alloc->slot, alloc_size, VGC_RECORD_NONE);
+            }
+            if (gc->dirty) {
+                vgc_dirty_touch(gc, ptr, alloc_size);
+            }
+        } else {
+            /* We failed to allocate the metadata, fail cleanly. */
+            free(ptr);
+            ptr = NULL;
+        }
+    }
+    return ptr;
+}
+
+static void vgc_make_root(vgc_GC *gc, void * const ptr) {
+    vgc_Allocation *alloc = vgc_allocation_get(gc, ptr);
+    if (!alloc && vgc_region_promote(gc, ptr)) {
+        /* Roots must outlive the region they were allocated in */
+        alloc = vgc_allocation_map_get(gc->allocs, ptr);
+    }
+    if (alloc && !(alloc->tag & VGC_TAG_ROOT)) {
+        if (vgc_root_set_add(gc->roots, ptr)) {
+            alloc->tag |= VGC_TAG_ROOT;
+        }
+    }
+}
+
+void * vgc_malloc(vgc_GC *gc, size_t const size) {
+    return vgc_malloc_fast(gc, size, NULL);
+}
+
+vgc_Array * vgc_create_array(vgc_GC *gc, size_t tsize, size_t count) {
+    return vgc_create_array_ext(gc, tsize, count, NULL);
+}
+
+vgc_Array * vgc_create_array_ext(vgc_GC *gc, size_t tsize, size_t count, vgc_Deconstructor dtor) {
+    // Allocate the memory required by the array.
+    vgc_Array *array = vgcx_new_ext(gc, vgc_Array, dtor);
+
+    // Allocate an underlying buffer for the array to store its values.
+    vgc_Buffer *buffer = vgc_create_buffer(gc, count * tsize);
+
+    // Set the underlying buffer that the array represents.
+    vgc__array_set_buffer(array, buffer);
+
+    // Set the number of slots the array contains.
+    vgc__array_set_slot_count(array, count);
+
+    // Set the size of a single slot in the array.
+    vgc__array_set_slot_size(array, tsize);
+
+    return array;
+}
+
+vgc_Buffer * vgc_create_buffer(vgc_GC *gc, size_t size) {
+    return vgc_create_buffer_ext(gc, size, NULL);
+}
+
+vgc_Buffer * vgc_create_buffer_ext(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
+    // Create a new buffer.
+    vgc_Buffer *buffer = vgcx_new_ext(gc, vgc_Buffer, dtor);
+
+    // If a destructor was provided:
+    if (dtor == NULL) {
+        // Allocate the buffer's memory.
+        vgc__buffer_set_address(buffer, vgc_malloc(gc, size));
+        vgc__buffer_set_length(buffer, size);
+    }
+    // Otherwise:
+    else {
+        // Allocate the buffer's memory.
+        vgc__buffer_set_address(buffer, vgc_malloc_ext(gc, size, dtor));
+        vgc__buffer_set_length(buffer, size);
+    }
+
+    return buffer;
+}
+
+/*
+ * The headers of a compact array. The array header, its buffer header and
+ * the payload share one managed block, with the payload starting on the first
+ * cache line boundary past the headers.
+ */
+typedef struct vgc_CompactArray {
+    vgc_Array array;
+    vgc_Buffer buffer;
+} vgc_CompactArray;
+
+#define VGC_COMPACT_ARRAY_PAYLOAD_OFFSET    VGC_ALIGN_UP(sizeof(vgc_CompactArray), VGC_CACHE_LINE_SIZE)
+#define VGC_COMPACT_BUFFER_PAYLOAD_OFFSET   VGC_ALIGN_UP(sizeof(vgc_Buffer), VGC_CACHE_LINE_SIZE)
+
+vgc_Array * vgc_create_compact_array(vgc_GC *gc, size_t tsize, size_t count) {
+    return vgc_create_compact_array_ext(gc, tsize, count, NULL);
+}
+
+vgc_Array * vgc_create_compact_array_ext(vgc_GC *gc, size_t tsize, size_t count, vgc_Deconstructor dtor) {
+    /* Neither the payload nor the block size may wrap around */
+    if ((tsize && count > SIZE_MAX / tsize) || count * tsize > SIZE_MAX - VGC_COMPACT_ARRAY_PAYLOAD_OFFSET) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    size_t length = count * tsize;
+
+    // Allocate the headers and the payload as a single, cache-line-aligned block.
+    char *block = (char *) vgc_allocate(gc, 0, VGC_COMPACT_ARRAY_PAYLOAD_OFFSET + length,
+                                        VGC_CACHE_LINE_SIZE, dtor);
+    if (block == NULL) {
+        return NULL;
+    }
+    vgc_CompactArray *header = (vgc_CompactArray *) block;
+
+    // The buffer header lives right behind the array header.
+    vgc__buffer_set_address(&header->buffer, block + VGC_COMPACT_ARRAY_PAYLOAD_OFFSET);
+    vgc__buffer_set_length(&header->buffer, length);
+
+    vgc__array_set_buffer(&header->array, &header->buffer);
+    vgc__array_set_slot_count(&header->array, count);
+    vgc__array_set_slot_size(&header->array, tsize);
+
+    return &header->array;
+}
+
+vgc_Buffer * vgc_create_compact_buffer(vgc_GC *gc, size_t size) {
+    return vgc_create_compact_buffer_ext(gc, size, NULL);
+}
+
+vgc_Buffer * vgc_create_compact_buffer_ext(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
+    if (size > SIZE_MAX - VGC_COMPACT_BUFFER_PAYLOAD_OFFSET) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    // Allocate the header and the payload as a single, cache-line-aligned block.
+    char *block = (char *) vgc_allocate(gc, 0, VGC_COMPACT_BUFFER_PAYLOAD_OFFSET + size,
+                                        VGC_CACHE_LINE_SIZE, dtor);
+    if (block == NULL) {
+        return NULL;
+    }
+    vgc_Buffer *buffer = (vgc_Buffer *) block;
+
+    vgc__buffer_set_address(buffer, block + VGC_COMPACT_BUFFER_PAYLOAD_OFFSET);
+    vgc__buffer_set_length(buffer, size);
+
+    return buffer;
+}
+
+/*
+ * The vector header embeds its array and buffer headers, the storage is a
+ * separate block so that it can be resized with vgc_realloc().
+ */
+static vgc_Vector * vgc_vector_make(vgc_GC *gc, size_t item_size, size_t capacity, bool scanned) {
+    vgc_Vector *vector = vgcx_new_ext(gc, vgc_Vector, NULL);
+    if (vector == NULL) {
+        return NULL;
+    }
+    vgc__buffer_set_address(&vector->buffer, NULL);
+    vgc__buffer_set_length(&vector->buffer, 0);
+    vgc__array_set_buffer(&vector->array, &vector->buffer);
+    vgc__array_set_slot_count(&vector->array, 0);
+    vgc__array_set_slot_size(&vector->array, item_size);
+    vgc__vector_set_scanned(vector, scanned);
+    if (capacity && !vgc_vector_reserve(gc, vector, capacity)) {
+        return NULL;
+    }
+    return vector;
+}
+
+vgc_Vector * vgc_create_vector(vgc_GC *gc, size_t item_size, size_t capacity) {
+    return vgc_vector_make(gc, item_size, capacity, true);
+}
+
+vgc_Vector * vgc_create_vector_noscan(vgc_GC *gc, size_t item_size, size_t capacity) {
+    return vgc_vector_make(gc, item_size, capacity, false);
+}
+
+/*
+ * Resize the storage of a vector. The noscan tag is set when the storage is
+ * first allocated and vgc_realloc() carries it along.
+ */
+static bool vgc_vector_resize_storage(vgc_GC *gc, vgc_Vector *vector, size_t capacity) {
+    size_t item_size = vector->array.slot_size;
+    if (item_size && capacity > SIZE_MAX / item_size) {
+        return false;
+    }
+    size_t size = capacity * item_size;
+    void *storage;
+    if (size == 0) {
+        if (vector->buffer.address) {
+            vgc_free(gc, vector->buffer.address);
+        }
+        storage = NULL;
+    } else if (vector->buffer.address == NULL) {
+        storage = vector->scanned ? vgc_malloc(gc, size) : vgc_malloc_noscan(gc, size, NULL);
+    } else {
+        storage = vgc_realloc(gc, vector->buffer.address, size);
+    }
+    if (size && storage == NULL) {
+        return false;
+    }
+    if (vector->scanned && size > vector->buffer.length) {
+        // Stale words in unused slots would keep garbage alive.
+        memset((char *) storage + vector->buffer.length, 0, size - vector->buffer.length);
+    }
+    vgc__buffer_set_address(&vector->buffer, storage);
+    vgc__buffer_set_length(&vector->buffer, size);
+    return true;
+}
+
+static size_t vgc_vector_capacity(vgc_Vector *vector) {
+    return vector->array.slot_size ? vector->buffer.length / vector->array.slot_size : 0;
+}
+
+bool vgc_vector_reserve(vgc_GC *gc, vgc_Vector *vector, size_t capacity) {
+    if (capacity <= vgc_vector_capacity(vector)) {
+        return true;
+    }
+    return vgc_vector_resize_storage(gc, vector, capacity);
+}
+
+void * vgc_vector_push(vgc_GC *gc, vgc_Vector *vector, const void *item) {
+    size_t length = vector->array.slot_count;
+    size_t capacity = vgc_vector_capacity(vector);
+    if (length == capacity) {
+        // Grow geometrically, so appending is amortized O(1).
+        size_t grown = capacity < 4 ? 4 : capacity * 2;
+        if (grown < capacity || !vgc_vector_resize_storage(gc, vector, grown)) {
+            return NULL;
+        }
+    }
+    size_t item_size = vector->array.slot_size;
+    char *slot = (char *) vector->buffer.address + length * item_size;
+    if (item) {
+        memcpy(slot, item, item_size);
+    } else {
+        memset(slot, 0, item_size);
+    }
+    vgc__array_set_slot_count(&vector->array, length + 1);
+    return slot;
+}
+
+bool vgc_vector_pop(vgc_Vector *vector, void *item) {
+    size_t length = vector->array.slot_count;
+    if (length == 0) {
+        return false;
+    }
+    size_t item_size = vector->array.slot_size;
+    char *slot = (char *) vector->buffer.address + (length - 1) * item_size;
+    if (item) {
+        memcpy(item, slot, item_size);
+    }
+    // Do not keep the removed item's references alive.
+    memset(slot, 0, item_size);
+    vgc__array_set_slot_count(&vector->array, length - 1);
+    return true;
+}
+
+void vgc_vector_clear(vgc_Vector *vector) {
+    if (vector->buffer.address) {
+        memset(vector->buffer.address, 0, vector->array.slot_count * vector->array.slot_size);
+    }
+    vgc__array_set_slot_count(&vector->array, 0);
+}
+
+bool vgc_vector_shrink(vgc_GC *gc, vgc_Vector *vector) {
+    if (vector->array.slot_count == vgc_vector_capacity(vector)) {
+        return true;
+    }
+    return vgc_vector_resize_storage(gc, vector, vector->array.slot_count);
+}
+
+/*
+ * Slices point at their parent's header rather than into its payload, since
+ * only base addresses are found in the allocation map. The parent in turn
+ * keeps the payload alive.
+ */
+static vgc_Slice * vgc_slice_make(vgc_GC *gc, void *parent, char *address, size_t length) {
+    vgc_Slice *slice = vgcx_new_ext(gc, vgc_Slice, NULL);
+    if (slice == NULL) {
+        return NULL;
+    }
+    vgc__slice_set_parent(slice, parent);
+    vgc__slice_set_address(slice, address);
+    vgc__slice_set_length(slice, length);
+    return slice;
+}
+
+vgc_Slice * vgc_create_slice(vgc_GC *gc, vgc_Buffer *buffer, size_t offset, size_t length) {
+    if (offset > buffer->length || length > buffer->length - offset) {
+        return NULL;
+    }
+    return vgc_slice_make(gc, buffer, (char *) buffer->address + offset, length);
+}
+
+vgc_Slice * vgc_create_array_slice(vgc_GC *gc, vgc_Array *array, size_t first, size_t count) {
+    if (first > array->slot_count || count > array->slot_count - first) {
+        return NULL;
+    }
+    return vgc_slice_make(gc, array, (char *) array->buffer->address + first * array->slot_size,
+                          count * array->slot_size);
+}
+
+vgc_Slice * vgc_create_subslice(vgc_GC *gc, vgc_Slice *slice, size_t offset, size_t length) {
+    if (offset > slice->length || length > slice->length - offset) {
+        return NULL;
+    }
+    return vgc_slice_make(gc, slice->parent, (char *) slice->address + offset, length);
+}
+
+vgc_Array * vgc_split_buffer(vgc_GC *gc, vgc_Buffer *buffer, size_t record_size) {
+    if (record_size == 0) {
+        return NULL;
+    }
+    size_t count = (buffer->length + record_size - 1) / record_size;
+    vgc_Array *array = vgc_create_compact_array(gc, sizeof(vgc_Slice), count);
+    if (array == NULL) {
+        return NULL;
+    }
+    vgc_Slice *slices = (vgc_Slice *) array->buffer->address;
+    for (size_t i = 0; i < count; ++i) {
+        size_t offset = i * record_size;
+        size_t length = buffer->length - offset < record_size ? buffer->length - offset : record_size;
+        vgc__slice_set_parent(&slices[i], buffer);
+        vgc__slice_set_address(&slices[i], (char *) buffer->address + offset);
+        vgc__slice_set_length(&slices[i], length);
+    }
+    return array;
+}
+
+#if defined(VGC_MMAP)
+/*
+ * The header of a file-backed buffer. mmap() wants a page-aligned offset, so
+ * the mapping may start a little before the requested offset; the buffer
+ * address points at the requested byte and the header remembers the whole
+ * mapping for munmap().
+ */
+typedef struct vgc_MappedBuffer {
+    vgc_Buffer buffer;
+    void *base;
+    size_t size;
+} vgc_MappedBuffer;
+
+static void vgc_mapped_buffer_dtor(void *ptr) {
+    vgc_MappedBuffer *header = (vgc_MappedBuffer *) ptr;
+    if (header->base) {
+        munmap(header->base, header->size);
+    }
+}
+
+vgc_Buffer * vgc_create_buffer_mmap(vgc_GC *gc, int fd, size_t offset, size_t length, int flags) {
+    if (length == 0) {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size <= offset) {
+            LOG_WARNING("Nothing to map in fd %d past offset %zu", fd, offset);
+            return NULL;
+        }
+        length = (size_t) st.st_size - offset;
+    }
+
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t delta = offset % page;
+    int prot = PROT_READ;
+    int mode = MAP_SHARED;
+    if (flags & VGC_MMAP_WRITE) {
+        prot |= PROT_WRITE;
+    }
+    if (flags & VGC_MMAP_PRIVATE) {
+        prot |= PROT_WRITE;
+        mode = MAP_PRIVATE;
+    }
+#if defined(MAP_POPULATE)
+    if (flags & VGC_MMAP_POPULATE) {
+        mode |= MAP_POPULATE;
+    }
+#endif
+    void *base = mmap(NULL, length + delta, prot, mode, fd, (off_t) (offset - delta));
+    if (base == MAP_FAILED) {
+        LOG_WARNING("Failed to map fd %d at offset %zu (errno=%d)", fd, offset, errno);
+        return NULL;
+    }
+
+    // Only the header is managed, and it holds no managed pointers.
+    vgc_MappedBuffer *header = (vgc_MappedBuffer *) vgc_malloc_noscan(gc, sizeof(vgc_MappedBuffer),
+                                                                      vgc_mapped_buffer_dtor);
+    if (header == NULL) {
+        munmap(base, length + delta);
+        return NULL;
+    }
+    header->base = base;
+    header->size = length + delta;
+    vgc__buffer_set_address(&header->buffer, (char *) base + delta);
+    vgc__buffer_set_length(&header->buffer, length);
+
+    return &header->buffer;
+}
+#else
+vgc_Buffer * vgc_create_buffer_mmap(vgc_GC *gc, int fd, size_t offset, size_t length, int flags) {
+    (void) gc; (void) fd; (void) offset; (void) length; (void) flags;
+    LOG_WARNING("%s", "File-backed buffers need mmap()");
+    return NULL;
+}
+#endif
+
+void * vgc_malloc_static(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
+    void *ptr = vgc_malloc_ext(gc, size, dtor);
+    vgc_make_root(gc, ptr);
+    return ptr;
+}
+
+void * vgc_make_static(vgc_GC *gc, void *ptr) {
+    vgc_make_root(gc, ptr);
+    return ptr;
+}
+
+void * vgc_malloc_ext(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
+    void *ptr = vgc_span_allocate(gc, size, dtor);
+    return ptr ? ptr : vgc_allocate(gc, 0, size, 0, dtor);
+}
+
+void * vgc_malloc_noscan(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
+    void *ptr = vgc_allocate(gc, 0, size, 0, dtor);
+    /* Region objects are scanned once, when they are promoted */
+    vgc_Allocation *alloc = ptr ? vgc_allocation_map_get(gc->allocs, ptr) : NULL;
+    if (alloc) {
+        alloc->tag |= VGC_TAG_NOSCAN;
+    }
+    return ptr;
+}
+
+
+void * vgc_calloc(vgc_GC *gc, size_t count, size_t size) {
+    return vgc_calloc_ext(gc, count, size, NULL);
+}
+
+
+void * vgc_calloc_ext(vgc_GC *gc, size_t count, size_t size,
+                    vgc_Deconstructor dtor) {
+    return vgc_allocate(gc, count, size, 0, dtor);
+}
+
+
+static void vgc_weak_forward(vgc_GC *gc, void *from, void *to);
+static void vgc_snapshot_retain(vgc_GC *gc, void *ptr);
+
+void * vgc_realloc(vgc_GC *gc, void *p, size_t size) {
+    if (!p) {
+        // allocation, not reallocation; this may trigger a collection
+        return vgc_allocate(gc, 0, size, 0, NULL);
+    }
+    vgc_Allocation *alloc = vgc_allocation_get(gc, p);
+    if (!alloc) {
+        vgc_SpanObject *object = vgc_span_object_get(gc, p);
+        if (object && gc->region) {
+            // region objects are resized by copying them within the region
+            void *q = vgc_region_allocate(gc->region, 0, size, 0, object->dtor);
+            if (q) {
+                memcpy(q, p, object->size < size ? object->size : size);
+                // the copy takes over finalization
+                object->dtor = NULL;
+            }
+            return q;
+        }
+        // the user passed an unknown pointer
+        errno = EINVAL;
+        return NULL;
+    }
+    if (alloc->tag & VGC_TAG_INTERNED) {
+        // interned strings are shared with every other user of the string
+        errno = EINVAL;
+        return NULL;
+    }
+    uint32_t id = alloc->slot;
+    void *q;
+    if (alloc->tag & VGC_TAG_SPAN) {
+        // span memory cannot be resized, move it onto the system heap
+        q = malloc(size);
+        if (!q) {
+            return NULL;
+        }
+        memcpy(q, p, alloc->size < size ? alloc->size : size);
+        vgc_span_release(p);
+#if defined(VGC_USABLE_SIZE)
+    } else if (size > alloc->size && size <= VGC_USABLE_SIZE(p)) {
+        // grow into the slack of the block's size class
+        q = p;
+#endif
+    } else {
+        q = realloc(p, size);
+        if (!q) {
+            // realloc failed but p is still valid
+            return NULL;
+        }
+    }
+    if (p == q) {
+        // successful reallocation w/o copy
+        alloc->size = size;
+    } else {
+        // successful reallocation w/ copy, the allocation object moves along
+        char tag = alloc->tag & ~VGC_TAG_SPAN;
+        alloc = vgc_allocation_map_move(gc->allocs, p, q, size);
+        alloc->tag = tag;
+        if (tag & VGC_TAG_ROOT) {
+            vgc_root_set_replace(gc->roots, p, q);
+        }
+        if (tag & VGC_TAG_WEAK) {
+            vgc_weak_forward(gc, p, q);
+        }
+    }
+    if (gc->dirty) {
+        vgc_dirty_touch(gc, q, size);
+    }
+    if (gc->recorder) {
+        vgc_record_realloc(gc, id, q, size);
+    }
+    return q;
+}
+
+void vgc_free(vgc_GC *gc, void *ptr) {
+    vgc_Allocation *alloc = vgc_allocation_get(gc, ptr);
+    if (alloc && (alloc->tag & VGC_TAG_INTERNED)) {
+        LOG_WARNING("Ignoring request to free interned string %p", (void *) ptr);
+    } else if (alloc) {
+        if (gc->recorder) {
+            vgc_record(gc, VGC_RECORD_FREE, alloc->dtor ? VGC_RECORD_DTOR : 0, alloc->slot, alloc->size, VGC_RECORD_NONE);
+        }
+        if (alloc->tag & VGC_TAG_WEAK) {
+            vgc_weak_forward(gc, ptr, NULL);
+        }
+        if (alloc->dtor) {
+            alloc->dtor(ptr);
+        }
+        char tag = alloc->tag;
+        if (tag & VGC_TAG_ROOT) {
+            vgc_root_set_remove(gc->roots, ptr);
+        }
+        size_t size = alloc->size;
+        vgc_allocation_map_remove(gc->allocs, ptr, true);
+        vgc_recycle(gc, ptr, tag, size);
+    } else {
+        vgc_SpanObject *object = vgc_span_object_get(gc, ptr);
+        if (object) {
+            // finalize now, the memory goes away with the region
+            vgc_Deconstructor dtor = object->dtor;
+            object->dtor = NULL;
+            if (dtor) {
+                dtor(ptr);
+            }
+        } else {
+            LOG_WARNING("Ignoring request to free unknown pointer %p", (void *) ptr);
+        }
+    }
+}
+
+void vgc_start(vgc_GC *gc, void *stack_bp) {
+    vgc_start_ext(gc, stack_bp, 1024, 1024, 0.2, 0.8, 0.5);
+}
+
+void vgc_start_ext(vgc_GC *gc,
+                  void *stack_bp,
+                  size_t initial_capacity,
+                  size_t min_capacity,
+                  double downsize_load_factor,
+                  double upsize_load_factor,
+                  double sweep_factor) {
+    double downsize_limit = downsize_load_factor > 0.0 ? downsize_load_factor : 0.2;
+    double upsize_limit = upsize_load_factor > 0.0 ? upsize_load_factor : 0.8;
+    sweep_factor = sweep_factor > 0.0 ? sweep_factor : 0.5;
+    gc->disabled = false;
+    gc->scan_stack = true;
+    gc->stack_bp = stack_bp;
+    gc->stacks = NULL;
+    gc->region = NULL;
+    gc->span = NULL;
+    gc->snapshot = NULL;
+    gc->snapshot_mode = false;
+    gc->dirty = NULL;
+    gc->weak_refs = NULL;
+    gc->weak_maps = NULL;
+    gc->pools = NULL;
+    gc->pool_count = 0;
+    gc->trace = NULL;
+    gc->recorder = NULL;
+    gc->interns = NULL;
+    initial_capacity = initial_capacity < min_capacity ? min_capacity : initial_capacity;
+    gc->allocs = vgc_allocation_map_new(min_capacity, initial_capacity,
+                                       sweep_factor, downsize_limit, upsize_limit);
+    gc->roots = vgc_root_set_new();
+    gc->mark_queue = vgc_mark_queue_new();
+    LOG_DEBUG("Created new garbage collector (cap=%zu, siz=%zu).", gc->allocs->capacity,
+              (uint64_t) vgc_allocation_map_size(gc->allocs));
+}
+
+void vgc_disable(vgc_GC *gc) {
+    gc->disabled = true;
+}
+
+void vgc_enable(vgc_GC *gc) {
+    gc->disabled = false;
+}
+
+static void vgc_mark_push(vgc_GC *gc, void *ptr);
+
+/**
+ * A scan kernel.
+ *
+ * Scan kernels read the words in `[begin, end)`, discard every word outside
+ * of the heap bounds `[lo, hi]` and hand the surviving candidates to
+ * `vgc_mark_push()`.
+ */
+typedef void (*vgc_ScanKernel)(vgc_GC *gc, void **begin, void **end, uintptr_t lo, uintptr_t hi);
+
+static void vgc_scan_scalar(vgc_GC *gc, void **begin, void **end, uintptr_t lo, uintptr_t hi) {
+    uintptr_t span = hi - lo;
+    for (void **p = begin; p < end; ++p) {
+        if ((uintptr_t) *p - lo <= span) {
+            vgc_mark_push(gc, *p);
+        }
+    }
+}
+
+#if defined(VGC_SCAN_X86) && UINTPTR_MAX == UINT64_MAX
+
+/*
+ * There is no unsigned 64-bit compare on x86, so both sides are biased
+ * into the signed range: (x - lo) > (hi - lo) as unsigned equals
+ * (x - lo) ^ bias > (hi - lo) ^ bias as signed.
+ */
+#define VGC_SCAN_BIAS ((long long) 0x8000000000000000ULL)
+
+__attribute__((target("sse4.2")))
+static void vgc_scan_sse42(vgc_GC *gc, void **begin, void **end, uintptr_t lo, uintptr_t hi) {
+    const __m128i bias = _mm_set1_epi64x(VGC_SCAN_BIAS);
+    const __m128i vlo = _mm_set1_epi64x((long long) lo);
+    const __m128i vspan = _mm_xor_si128(_mm_set1_epi64x((long long) (hi - lo)), bias);
+    void **p = begin;
+    for (; p + 4 <= end; p += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *) p);
+        __m128i b = _mm_loadu_si128((const __m128i *) (p + 2));
+        __m128i out_a = _mm_cmpgt_epi64(_mm_xor_si128(_mm_sub_epi64(a, vlo), bias), vspan);
+        __m128i out_b = _mm_cmpgt_epi64(_mm_xor_si128(_mm_sub_epi64(b, vlo), bias), vspan);
+        unsigned hits = ~((unsigned) _mm_movemask_pd(_mm_castsi128_pd(out_a))
+                          | (unsigned) _mm_movemask_pd(_mm_castsi128_pd(out_b)) << 2) & 0xF;
+        while (hits) {
+            vgc_mark_push(gc, p[vgc_ctz64(hits)]);
+            hits &= hits - 1;
+        }
+    }
+    vgc_scan_scalar(gc, p, end, lo, hi);
+}
+
+__attribute__((target("avx2")))
+static void vgc_scan_avx2(vgc_GC *gc, void **begin, void **end, uintptr_t lo, uintptr_t hi) {
+    const __m256i bias = _mm256_set1_epi64x(VGC_SCAN_BIAS);
+    const __m256i vlo = _mm256_set1_epi64x((long long) lo);
+    const __m256i vspan = _mm256_xor_si256(_mm256_set1_epi64x((long long) (hi - lo)), bias);
+    void **p = begin;
+    for (; p + 8 <= end; p += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *) p);
+        __m256i b = _mm256_loadu_si256((const __m256i *) (p + 4));
+        __m256i out_a = _mm256_cmpgt_epi64(_mm256_xor_si256(_mm256_sub_epi64(a, vlo), bias), vspan);
+        __m256i out_b = _mm256_cmpgt_epi64(_mm256_xor_si256(_mm256_sub_epi64(b, vlo), bias), vspan);
+        unsigned hits = ~((unsigned) _mm256_movemask_pd(_mm256_castsi256_pd(out_a))
+                          | (unsigned) _mm256_movemask_pd(_mm256_castsi256_pd(out_b)) << 4) & 0xFF;
+        while (hits) {
+            vgc_mark_push(gc, p[vgc_ctz64(hits)]);
+            hits &= hits - 1;
+        }
+    }
+    vgc_scan_scalar(gc, p, end, lo, hi);
+}
+
+#endif // VGC_SCAN_X86
+
+#if defined(VGC_SCAN_NEON)
+
+static void vgc_scan_neon(vgc_GC *gc, void **begin, void **end, uintptr_t lo, uintptr_t hi) {
+    const uint64x2_t vlo = vdupq_n_u64(lo);
+    const uint64x2_t vspan = vdupq_n_u64(hi - lo);
+    void **p = begin;
+    for (; p + 4 <= end; p += 4) {
+        uint64x2_t in_a = vcleq_u64(vsubq_u64(vld1q_u64((const uint64_t *) p), vlo), vspan);
+        uint64x2_t in_b = vcleq_u64(vsubq_u64(vld1q_u64((const uint64_t *) (p + 2)), vlo), vspan);
+        /* Skip the lane extraction when nothing is in range */
+        if (!vmaxvq_u32(vreinterpretq_u32_u64(vorrq_u64(in_a, in_b)))) {
+            continue;
+        }
+        if (vgetq_lane_u64(in_a, 0)) vgc_mark_push(gc, p[0]);
+        if (vgetq_lane_u64(in_a, 1)) vgc_mark_push(gc, p[1]);
+        if (vgetq_lane_u64(in_b, 0)) vgc_mark_push(gc, p[2]);
+        if (vgetq_lane_u64(in_b, 1)) vgc_mark_push(gc, p[3]);
+    }
+    vgc_scan_scalar(gc, p, end, lo, hi);
+}
+
+#endif // VGC_SCAN_NEON
+
+/**
+ * Pick the widest scan kernel the CPU supports.
+ */
+static vgc_ScanKernel vgc_scan_kernel_select(void) {
+#if defined(VGC_SCAN_X86) && UINTPTR_MAX == UINT64_MAX
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return vgc_scan_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return vgc_scan_sse42;
+    }
+#elif defined(VGC_SCAN_NEON)
+    return vgc_scan_neon;
+#endif
+    return vgc_scan_scalar;
+}
+
+static vgc_ScanKernel vgc_scan_kernel = NULL;
+
+/**
+ * Conservatively scan a range of memory for candidate pointers.
+ *
+ * Only pointer-aligned words are considered. Candidates are queued, use
+ * `vgc_mark_drain()` to finish marking.
+ *
+ * @param gc A pointer to a garbage collector instance.
+ * @param begin The first byte of the range.
+ * @param end One past the last byte of the range.
+ */
+static void vgc_scan(vgc_GC *gc, void *begin, void *end) {
+    void **p = (void **) VGC_ALIGN_UP((uintptr_t) begin, VGC_PTRSIZE);
+    void **q = (void **) ((uintptr_t) end & ~((uintptr_t) VGC_PTRSIZE - 1));
+    vgc_AllocationMap *am = gc->allocs;
+    /* Nothing to find if the range is too small to hold a pointer or the heap is empty */
+    if (p >= q || am->min_ptr > am->max_ptr) {
+        return;
+    }
+    if (!vgc_scan_kernel) {
+        vgc_scan_kernel = vgc_scan_kernel_select();
+    }
+    vgc_scan_kernel(gc, p, q, am->min_ptr, am->max_ptr);
+}
+
+/**
+ * Queue a marked allocation for scanning and prefetch its contents.
+ */
+static void vgc_mark_gray(vgc_GC *gc, vgc_Allocation *alloc) {
+    vgc_MarkQueue *mq = gc->mark_queue;
+    if (mq->gray_size == mq->gray_capacity) {
+        size_t capacity = mq->gray_capacity ? 2 * mq->gray_capacity : 256;
+        vgc_Allocation **gray = (vgc_Allocation **) realloc(mq->gray, capacity * sizeof(vgc_Allocation *));
+        if (!gray) {
+            /* Out of memory, scan right away at the cost of recursion */
+            vgc_scan(gc, alloc->ptr, (char *) alloc->ptr + alloc->size);
+            return;
+        }
+        mq->gray = gray;
+        mq->gray_capacity = capacity;
+    }
+    VGC_PREFETCH(alloc->ptr);
+    mq->gray[mq->gray_size++] = alloc;
+}
+
+/**
+ * Mark the allocation a candidate pointer refers to, if any.
+ */
+static void vgc_mark_process(vgc_GC *gc, void *ptr) {
+    vgc_Allocation *alloc = vgc_allocation_map_find(gc->allocs, ptr);
+    /* Mark if alloc exists and is not tagged already, otherwise skip */
+    if (alloc && !vgc_allocation_is_marked(gc->allocs, alloc)) {
+        LOG_DEBUG("Marking allocation (ptr=%p)", ptr);
+        vgc_allocation_mark(gc->allocs, alloc);
+        if (!(alloc->tag & VGC_TAG_NOSCAN)) {
+            vgc_mark_gray(gc, alloc);
+        }
+    }
+}
+
+/**
+ * Queue a candidate pointer.
+ *
+ * The candidate's hash bucket is prefetched now and the candidate is looked
+ * up `VGC_PREFETCH_DEPTH` candidates later, in the style of Boehm's
+ * prefetch-on-push.
+ */
+static void vgc_mark_push(vgc_GC *gc, void *ptr) {
+#if VGC_PREFETCH_DEPTH > 0
+    vgc_MarkQueue *mq = gc->mark_queue;
+    vgc_AllocationMap *am = gc->allocs;
+    VGC_PREFETCH(&am->allocs[vgc_hash(ptr) % am->capacity]);
+    if (mq->count < VGC_PREFETCH_DEPTH) {
+        mq->fifo[(mq->head + mq->count++) % VGC_PREFETCH_DEPTH] = ptr;
+        return;
+    }
+    void *oldest = mq->fifo[mq->head];
+    mq->fifo[mq->head] = ptr;
+    mq->head = (mq->head + 1) % VGC_PREFETCH_DEPTH;
+    vgc_mark_process(gc, oldest);
+#else
+    vgc_mark_process(gc, ptr);
+#endif
+}
+
+/**
+ * Process queued candidates and scan gray allocations until both are empty.
+ */
+static void vgc_mark_drain(vgc_GC *gc) {
+    vgc_MarkQueue *mq = gc->mark_queue;
+    for (;;) {
+        if (mq->gray_size) {
+            /* Scanning first keeps the FIFO full and the prefetch distance long */
+            vgc_Allocation *alloc = mq->gray[--mq->gray_size];
+            LOG_DEBUG("Checking allocation (ptr=%p, size=%zu) contents", alloc->ptr, alloc->size);
+            vgc_scan(gc, alloc->ptr, (char *) alloc->ptr + alloc->size);
+#if VGC_PREFETCH_DEPTH > 0
+        } else if (mq->count) {
+            void *ptr = mq->fifo[mq->head];
+            mq->head = (mq->head + 1) % VGC_PREFETCH_DEPTH;
+            mq->count--;
+            vgc_mark_process(gc, ptr);
+#endif
+        } else {
+            break;
+        }
+    }
+}
+
+/**
+ * Conservatively mark everything referenced from a range of memory.
+ *
+ * @param gc A pointer to a garbage collector instance.
+ * @param begin The first byte of the range.
+ * @param end One past the last byte of the range.
+ */
+static void vgc_mark_range(vgc_GC *gc, void *begin, void *end) {
+    vgc_scan(gc, begin, end);
+    vgc_mark_drain(gc);
+}
+
+void vgc_mark_alloc(vgc_GC *gc, void *ptr) {
+    vgc_span_flush(gc);
+    vgc_mark_push(gc, ptr);
+    vgc_mark_drain(gc);
+}
+
+void vgc_mark_stack(vgc_GC *gc) {
+    LOG_DEBUG("Marking the stack (gc@%p) in increments of %zu", (void *) gc, VGC_PTRSIZE);
+    void *stack_sp = __builtin_frame_address(0);
+    void *stack_bp = gc->stack_bp;
+    vgc_span_flush(gc);
+    /* The stack grows towards smaller memory addresses, hence we scan stack_sp->stack_bp. */
+    vgc_mark_range(gc, stack_sp, stack_bp);
+    /* Suspended stacks are scanned from their saved stack pointer */
+    for (vgc_Stack *stack = gc->stacks; stack; stack = stack->next) {
+        if (stack->base != stack_bp && stack->sp) {
+            LOG_DEBUG("Marking stack %p-%p", stack->sp, stack->base);
+            vgc_mark_range(gc, stack->sp, stack->base);
+        }
+    }
+}
+
+/**
+ * Mark everything referenced from the objects of the active regions.
+ *
+ * Region objects are not tracked individually, so the used part of every
+ * span is scanned as a whole.
+ *
+ * @param gc A pointer to a garbage collector instance.
+ */
+void vgc_mark_regions(vgc_GC *gc) {
+    for (vgc_Region *region = gc->region; region; region = region->parent) {
+        for (vgc_Span *span = region->spans; span; span = span->next) {
+            LOG_DEBUG("Marking span %p", (void *) span);
+            vgc_mark_range(gc, span->data, span->data + span->used);
+        }
+    }
+}
+
+void vgc_mark_roots(vgc_GC *gc) {
+    LOG_DEBUG("Marking roots%s", "");
+    vgc_span_flush(gc);
+    vgc_RootSet *rs = gc->roots;
+    for (size_t i = 0; i < rs->size; ++i) {
+        LOG_DEBUG("Marking root @ %p", rs->roots[i]);
+        vgc_mark_alloc(gc, rs->roots[i]);
+    }
+    for (size_t i = 0; i < rs->range_count; ++i) {
+        LOG_DEBUG("Marking root range %p-%p", rs->ranges[i].begin, rs->ranges[i].end);
+        vgc_mark_range(gc, rs->ranges[i].begin, rs->ranges[i].end);
+    }
+    for (vgc_ShadowRoot *root = rs->shadow; root; root = root->next) {
+        if (root->ptr) {
+            vgc_mark_push(gc, root->ptr);
+        }
+    }
+    vgc_mark_drain(gc);
+}
+
+/*
+ * Weak references and weak maps.
+ *
+ * Both are managed objects: they are allocated as "noscan" so that the
+ * pointers they hold do not keep anything alive, and their destructors
+ * unregister them. Targets and keys are tagged as "weak". The sweep clears
+ * references to garbage in one pass; targets freed one at a time (by
+ * `vgc_free()`, `vgc_realloc()` or a snapshot collection) are looked up in
+ * every weak reference and weak map instead.
+ */
+
+typedef struct vgc_WeakEntry {
+    void *key;                      // the key (or `NULL` if the entry is empty)
+    void *value;                    // the value
+} vgc_WeakEntry;
+
+struct vgc_WeakMap {
+    vgc_GC *gc;                     // the owning garbage collector
+    vgc_WeakEntry *entries;         // open addressing with linear probing
+    size_t size;                    // number of entries
+    size_t capacity;                // capacity of `entries` (a power of two)
+    struct vgc_WeakMap *prev;       // previous registered weak map
+    struct vgc_WeakMap *next;       // next registered weak map
+};
+
+/*
+ * Weak objects bypass regions, whose spans are scanned as a whole.
+ */
+static void * vgc_weak_allocate(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
+    vgc_Region *region = gc->region;
+    gc->region = NULL;
+    void *ptr = vgc_malloc_noscan(gc, size, dtor);
+    gc->region = region;
+    return ptr;
+}
+
+static bool vgc_weak_tag(vgc_GC *gc, void *ptr) {
+    vgc_Allocation *alloc = vgc_allocation_get(gc, ptr);
+    if (!alloc) {
+        return false;
+    }
+    alloc->tag |= VGC_TAG_WEAK;
+    return true;
+}
+
+static void vgc_weak_ref_delete(void *ptr) {
+    vgc_WeakRef *ref = (vgc_WeakRef *) ptr;
+    if (ref->prev) {
+        ref->prev->next = ref->next;
+    } else {
+        ref->gc->weak_refs = ref->next;
+    }
+    if (ref->next) {
+        ref->next->prev = ref->prev;
+    }
+}
+
+vgc_WeakRef * vgc_create_weak_ref(vgc_GC *gc, void *target) {
+    if (target && !vgc_weak_tag(gc, target)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    vgc_WeakRef *ref = (vgc_WeakRef *) vgc_weak_allocate(gc, sizeof(vgc_WeakRef), vgc_weak_ref_delete);
+    if (!ref) {
+        return NULL;
+    }
+    ref->target = target;
+    ref->gc = gc;
+    ref->prev = NULL;
+    ref->next = gc->weak_refs;
+    if (gc->weak_refs) {
+        gc->weak_refs->prev = ref;
+    }
+    gc->weak_refs = ref;
+    return ref;
+}
+
+void * vgc_weak_ref_get(const vgc_WeakRef *ref) {
+    /* The marker child may already count the target as garbage */
+    vgc_snapshot_retain(ref->gc, ref->target);
+    return ref->target;
+}
+
+static void vgc_weak_map_delete(void *ptr) {
+    vgc_WeakMap *map = (vgc_WeakMap *) ptr;
+    if (map->prev) {
+        map->prev->next = map->next;
+    } else {
+        map->gc->weak_maps = map->next;
+    }
+    if (map->next) {
+        map->next->prev = map->prev;
+    }
+    free(map->entries);
+}
+
+vgc_WeakMap * vgc_create_weak_map(vgc_GC *gc) {
+    vgc_WeakMap *map = (vgc_WeakMap *) vgc_weak_allocate(gc, sizeof(vgc_WeakMap), vgc_weak_map_delete);
+    if (!map) {
+        return NULL;
+    }
+    map->gc = gc;
+    map->entries = NULL;
+    map->size = 0;
+    map->capacity = 0;
+    map->prev = NULL;
+    map->next = gc->weak_maps;
+    if (gc->weak_maps) {
+        gc->weak_maps->prev = map;
+    }
+    gc->weak_maps = map;
+    return map;
+}
+
+static size_t vgc_weak_map_find(const vgc_WeakMap *map, const void *key) {
+    size_t mask = map->capacity - 1;
+    size_t i = vgc_hash((void *) key) & mask;
+    while (map->entries[i].key && map->entries[i].key != key) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static bool vgc_weak_map_grow(vgc_WeakMap *map) {
+    size_t capacity = map->capacity ? 2 * map->capacity : 16;
+    vgc_WeakEntry *entries = (vgc_WeakEntry *) calloc(capacity, sizeof(vgc_WeakEntry));
+    if (!entries) {
+        return false;
+    }
+    vgc_WeakEntry *old = map->entries;
+    size_t old_capacity = map->capacity;
+    map->entries = entries;
+    map->capacity = capacity;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old[i].key) {
+            map->entries[vgc_weak_map_find(map, old[i].key)] = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+/*
+ * Empty slot `i`, shifting back later entries of the same probe sequence.
+ */
+static void vgc_weak_map_erase(vgc_WeakMap *map, size_t i) {
+    size_t mask = map->capacity - 1;
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!map->entries[j].key) {
+            break;
+        }
+        size_t home = vgc_hash(map->entries[j].key) & mask;
+        /* Move the entry unless its home lies cyclically in (i, j] */
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            map->entries[i] = map->entries[j];
+            i = j;
+        }
+    }
+    map->entries[i].key = NULL;
+    map->entries[i].value = NULL;
+    map->size--;
+}
+
+bool vgc_weak_map_put(vgc_WeakMap *map, void *key, void *value) {
+    if (!key || !vgc_weak_tag(map->gc, key)) {
+        errno = EINVAL;
+        return false;
+    }
+    if (4 * (map->size + 1) > 3 * map->capacity && !vgc_weak_map_grow(map)) {
+        return false;
+    }
+    size_t i = vgc_weak_map_find(map, key);
+    if (!map->entries[i].key) {
+        map->entries[i].key = key;
+        map->size++;
+    }
+    map->entries[i].value = value;
+    return true;
+}
+
+void * vgc_weak_map_get(const vgc_WeakMap *map, const void *key) {
+    if (!map->size || !key) {
+        return NULL;
+    }
+    void *value = map->entries[vgc_weak_map_find(map, key)].value;
+    vgc_snapshot_retain(map->gc, value);
+    return value;
+}
+
+bool vgc_weak_map_remove(vgc_WeakMap *map, const void *key) {
+    if (!map->size || !key) {
+        return false;
+    }
+    size_t i = vgc_weak_map_find(map, key);
+    if (!map->entries[i].key) {
+        return false;
+    }
+    vgc_weak_map_erase(map, i);
+    return true;
+}
+
+size_t vgc_weak_map_size(const vgc_WeakMap *map) {
+    return map->size;
+}
+
+static bool vgc_weak_is_marked(vgc_GC *gc, const void *ptr) {
+    vgc_Allocation *alloc = vgc_allocation_map_find(gc->allocs, (void *) ptr);
+    return !alloc || vgc_allocation_is_marked(gc->allocs, alloc);
+}
+
+/**
+ * Mark the values of reachable weak maps whose keys are reachable.
+ *
+ * Marking a value can make further keys reachable, so the maps are scanned
+ * until a full pass marks nothing new.
+ */
+static void vgc_mark_ephemerons(vgc_GC *gc) {
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (vgc_WeakMap *map = gc->weak_maps; map; map = map->next) {
+            if (!vgc_weak_is_marked(gc, map)) {
+                continue;
+            }
+            for (size_t i = 0; i < map->capacity; ++i) {
+                vgc_WeakEntry *entry = &map->entries[i];
+                if (entry->key && vgc_weak_is_marked(gc, entry->key) && !vgc_weak_is_marked(gc, entry->value)) {
+                    vgc_mark_alloc(gc, entry->value);
+                    changed = true;
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Check whether a weak target is garbage. Garbage is untagged, so that
+ * sweeping it does not look it up again.
+ */
+static bool vgc_weak_is_garbage(vgc_GC *gc, void *ptr) {
+    vgc_Allocation *alloc = vgc_allocation_map_find(gc->allocs, ptr);
+    if (!alloc || vgc_allocation_is_marked(gc->allocs, alloc)) {
+        return false;
+    }
+    alloc->tag &= ~VGC_TAG_WEAK;
+    return true;
+}
+
+/**
+ * Clear weak references to unmarked allocations and drop weak map entries
+ * with unmarked keys.
+ */
+static void vgc_weak_sweep(vgc_GC *gc) {
+    for (vgc_WeakRef *ref = gc->weak_refs; ref; ref = ref->next) {
+        if (ref->target && vgc_weak_is_garbage(gc, ref->target)) {
+            ref->target = NULL;
+        }
+    }
+    for (vgc_WeakMap *map = gc->weak_maps; map; map = map->next) {
+        size_t i = 0;
+        while (i < map->capacity) {
+            vgc_WeakEntry *entry = &map->entries[i];
+            if (entry->key && vgc_weak_is_garbage(gc, entry->key)) {
+                /* Re-check the slot, erasing shifts the next entry into it */
+                vgc_weak_map_erase(map, i);
+            } else {
+                ++i;
+            }
+        }
+    }
+}
+
+/**
+ * Retarget weak references and weak map keys from `from` to `to`, or clear
+ * and drop them if `to` is `NULL`.
+ */
+static void vgc_weak_forward(vgc_GC *gc, void *from, void *to) {
+    for (vgc_WeakRef *ref = gc->weak_refs; ref; ref = ref->next) {
+        if (ref->target == from) {
+            ref->target = to;
+        }
+    }
+    for (vgc_WeakMap *map = gc->weak_maps; map; map = map->next) {
+        if (!map->size) {
+            continue;
+        }
+        size_t i = vgc_weak_map_find(map, from);
+        if (map->entries[i].key) {
+            void *value = map->entries[i].value;
+            vgc_weak_map_erase(map, i);
+            if (to) {
+                vgc_weak_map_put(map, to, value);
+            }
+        }
+    }
+}
+
+/*
+ * String interning.
+ *
+ * The table lives outside the managed heap, so it does not keep its strings
+ * alive. Every interned string carries a pointer to the table behind its
+ * terminator, which lets its destructor drop the entry no matter whether the
+ * string is collected or the collector stops.
+ */
+
+typedef struct vgc_InternEntry {
+    uint64_t hash;                  // the hash of the string
+    char *str;                      // the interned string (or `NULL` if the entry is empty)
+} vgc_InternEntry;
+
+struct vgc_InternTable {
+    vgc_InternEntry *entries;       // open addressing with linear probing
+    size_t size;                    // number of entries
+    size_t capacity;                // capacity of `entries` (a power of two)
+};
+
+static uint64_t vgc_intern_hash(const char *str, size_t len) {
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ (unsigned char) str[i]) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*
+ * Find the entry holding a string equal to `str`, or the empty entry where it
+ * belongs.
+ */
+static size_t vgc_intern_find(const struct vgc_InternTable *table, uint64_t hash, const char *str, size_t len) {
+    size_t mask = table->capacity - 1;
+    size_t i = (size_t) hash & mask;
+    while (table->entries[i].str &&
+           (table->entries[i].hash != hash || memcmp(table->entries[i].str, str, len + 1) != 0)) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static bool vgc_intern_grow(struct vgc_InternTable *table) {
+    size_t capacity = table->capacity ? 2 * table->capacity : 64;
+    vgc_InternEntry *entries = (vgc_InternEntry *) calloc(capacity, sizeof(vgc_InternEntry));
+    if (!entries) {
+        return false;
+    }
+    vgc_InternEntry *old = table->entries;
+    size_t old_capacity = table->capacity;
+    table->entries = entries;
+    table->capacity = capacity;
+    for (size_t i = 0; i < old_capacity; ++i) {
+        if (old[i].str) {
+            size_t j = (size_t) old[i].hash & (capacity - 1);
+            while (entries[j].str) {
+                j = (j + 1) & (capacity - 1);
+            }
+            entries[j] = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+/*
+ * Empty slot `i`, shifting back later entries of the same probe sequence.
+ */
+static void vgc_intern_erase(struct vgc_InternTable *table, size_t i) {
+    size_t mask = table->capacity - 1;
+    size_t j = i;
+    for (;;) {
+        j = (j + 1) & mask;
+        if (!table->entries[j].str) {
+            break;
+        }
+        size_t home = (size_t) table->entries[j].hash & mask;
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            table->entries[i] = table->entries[j];
+            i = j;
+        }
+    }
+    table->entries[i].str = NULL;
+    table->size--;
+}
+
+static void vgc_intern_delete(void *ptr) {
+    char *str = (char *) ptr;
+    size_t len = strlen(str);
+    struct vgc_InternTable *table;
+    memcpy(&table, str + len + 1, sizeof(table));
+    size_t mask = table->capacity - 1;
+    size_t i = (size_t) vgc_intern_hash(str, len) & mask;
+    while (table->entries[i].str) {
+        if (table->entries[i].str == str) {
+            vgc_intern_erase(table, i);
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static void vgc_intern_table_delete(vgc_GC *gc) {
+    if (gc->interns) {
+        free(gc->interns->entries);
+        free(gc->interns);
+        gc->interns = NULL;
+    }
+}
+
+const char * vgc_intern(vgc_GC *gc, const char *str) {
+    if (!gc->interns) {
+        gc->interns = (struct vgc_InternTable *) calloc(1, sizeof(struct vgc_InternTable));
+        if (!gc->interns) {
+            return NULL;
+        }
+    }
+    struct vgc_InternTable *table = gc->interns;
+    if (4 * (table->size + 1) > 3 * table->capacity && !vgc_intern_grow(table)) {
+        return NULL;
+    }
+    size_t len = strlen(str);
+    uint64_t hash = vgc_intern_hash(str, len);
+    size_t i = vgc_intern_find(table, hash, str, len);
+    if (table->entries[i].str) {
+        /* The marker child may already count the interned copy as garbage */
+        vgc_snapshot_retain(gc, table->entries[i].str);
+        return table->entries[i].str;
+    }
+    char *copy = (char *) vgc_weak_allocate(gc, len + 1 + sizeof(table), vgc_intern_delete);
+    if (!copy) {
+        return NULL;
+    }
+    memcpy(copy, str, len + 1);
+    memcpy(copy + len + 1, &table, sizeof(table));
+    vgc_allocation_map_get(gc->allocs, copy)->tag |= VGC_TAG_INTERNED;
+    /* The allocation may have collected interned strings and moved entries */
+    i = vgc_intern_find(table, hash, str, len);
+    table->entries[i].hash = hash;
+    table->entries[i].str = copy;
+    table->size++;
+    return copy;
+}
+
+size_t vgc_intern_count(vgc_GC *gc) {
+    return gc->interns ? gc->interns->size : 0;
+}
+
+void vgc_mark(vgc_GC *gc) {
+    /* Note: We only look at the stack, the heap and registered root ranges. */
+    LOG_DEBUG("Initiating GC mark (gc@%p)", (void *) gc);
+    /* The marks of a snapshot in flight protect allocations made since */
+    if (gc->snapshot) {
+        vgc_snapshot_end(gc);
+    }
+    /* Scan the heap for roots */
+    vgc_mark_roots(gc);
+    /* Objects in active regions are roots as well */
+    vgc_mark_regions(gc);
+    if (gc->scan_stack) {
+        /* Dump registers onto stack and scan the stack */
+        void (*volatile _mark_stack)(vgc_GC*) = vgc_mark_stack;
+        jmp_buf ctx;
+        memset(&ctx, 0, sizeof(jmp_buf));
+        setjmp(ctx);
+        _mark_stack(gc);
+    }
+    /* Values of weak maps live as long as their keys */
+    if (gc->weak_maps) {
+        vgc_mark_ephemerons(gc);
+    }
+}
+
+/**
+ * Check whether a page holds any allocation that is live but not marked.
+ *
+ * Tests the page's 256 bits of both side bitmaps in one go where AVX2 is
+ * available.
+ */
+static bool vgc_page_has_garbage(const uint64_t *live, const uint64_t *marks) {
+#if defined(__AVX2__)
+    __m256i l = _mm256_loadu_si256((const __m256i *) live);
+    __m256i m = _mm256_loadu_si256((const __m256i *) marks);
+    /* testc computes (~marks & live) == 0 */
+    return !_mm256_testc_si256(m, l);
+#else
+    uint64_t garbage = 0;
+    for (size_t i = 0; i < VGC_PAGE_WORDS; ++i) {
+        garbage |= live[i] & ~marks[i];
+    }
+    return garbage != 0;
+#endif
+}
+
+/**
+ * Free the allocation in a slot if it is live but unmarked.
+ *
+ * @returns The number of bytes freed.
+ */
+static size_t vgc_sweep_slot(vgc_GC *gc, size_t slot) {
+    vgc_AllocationMap *am = gc->allocs;
+    size_t word = VGC_SLOT_WORD(slot);
+    /* Destructors may have freed or reused the slot in the meantime */
+    if (!(am->live[word] & ~am->marks[word] & VGC_SLOT_MASK(slot))) {
+        return 0;
+    }
+    vgc_Allocation *chunk = &am->pages[slot / VGC_PAGE_SLOTS][slot % VGC_PAGE_SLOTS];
+    void *ptr = chunk->ptr;
+    char tag = chunk->tag;
+    size_t size = chunk->size;
+    LOG_DEBUG("Found unused allocation %p (%zu bytes @ ptr=%p)", (void *) chunk, chunk->size, ptr);
+    if (gc->recorder) {
+        vgc_record(gc, VGC_RECORD_SWEEP, 0, (uint32_t) slot, size, VGC_RECORD_NONE);
+    }
+    /* no reference to this chunk, hence delete it */
+    if (tag & VGC_TAG_WEAK) {
+        vgc_weak_forward(gc, ptr, NULL);
+    }
+    if (chunk->dtor) {
+        chunk->dtor(ptr);
+    }
+    vgc_recycle(gc, ptr, tag, size);
+    /* and remove it from the bookkeeping */
+    vgc_allocation_map_remove(am, ptr, false);
+    return size;
+}
+
+static void vgc_dirty_reset(vgc_GC *gc);
+
+size_t vgc_sweep(vgc_GC *gc) {
+    LOG_DEBUG("Initiating GC sweep (gc@%p)", (void *) gc);
+    vgc_AllocationMap *am = gc->allocs;
+    size_t total = 0;
+    /* Clear weak references to garbage in one pass over them */
+    if (gc->weak_refs || gc->weak_maps) {
+        vgc_weak_sweep(gc);
+    }
+    am->sweeping = true;
+    for (size_t page = 0; page < am->page_count; ++page) {
+        size_t base = page * VGC_PAGE_WORDS;
+        /* Skip pages in which everything is either marked or unused */
+        if (!vgc_page_has_garbage(am->live + base, am->marks + base)) {
+            continue;
+        }
+        for (size_t word = base; word < base + VGC_PAGE_WORDS; ++word) {
+            uint64_t garbage = am->live[word] & ~am->marks[word];
+            while (garbage) {
+                size_t slot = word * 64 + vgc_ctz64(garbage);
+                garbage &= garbage - 1;
+                total += vgc_sweep_slot(gc, slot);
+            }
+        }
+    }
+    am->sweeping = false;
+    /* unmark everything for the next cycle */
+    if (am->page_count) {
+        memset(am->marks, 0, am->page_count * VGC_PAGE_WORDS * sizeof(uint64_t));
+    }
+    vgc_allocation_map_resize_to_fit(am);
+    /* Start recording writes for the next cycle */
+    if (gc->dirty) {
+        vgc_dirty_reset(gc);
+    }
+    if (gc->trace) {
+        vgc_trace(gc, VGC_TRACE_SWEEP_END, total, vgc_allocation_map_size(am));
+    }
+    return total;
+}
+
+/**
+ * Unset the ROOT tag on all roots on the heap and drop all root ranges.
+ *
+ * @param gc A pointer to a garbage collector instance.
+ */
+void vgc_unroot_roots(vgc_GC *gc) {
+    LOG_DEBUG("Unmarking roots%s", "");
+    vgc_RootSet *rs = gc->roots;
+    for (size_t i = 0; i < rs->size; ++i) {
+        vgc_Allocation *alloc = vgc_allocation_map_get(gc->allocs, rs->roots[i]);
+        if (alloc) {
+            alloc->tag &= ~VGC_TAG_ROOT;
+        }
+    }
+    rs->size = 0;
+    rs->range_count = 0;
+    rs->shadow = NULL;
+}
+
+size_t vgc_stop(vgc_GC *gc) {
+    vgc_record_stop(gc);
+    size_t collected = vgc_snapshot_end(gc);
+    vgc_dirty_tracking_stop(gc);
+    /* Unroot first, so that ending the regions promotes as little as possible */
+    vgc_unroot_roots(gc);
+    while (gc->region) {
+        collected += vgc_region_end(gc);
+    }
+    vgc_span_retire(gc);
+    collected += vgc_sweep(gc);
+    vgc_allocation_map_delete(gc->allocs);
+    vgc_root_set_delete(gc->roots);
+    vgc_mark_queue_delete(gc->mark_queue);
+    vgc_pool_delete_all(gc);
+    vgc_intern_table_delete(gc);
+    vgc_trace_stop(gc);
+    return collected;
+}
+
+size_t vgc_collect(vgc_GC *gc) {
+    LOG_DEBUG("Initiating GC run (gc@%p)", (void *) gc);
+    if (gc->recorder) {
+        vgc_record_collect(gc);
+    }
+    if (gc->trace) {
+        vgc_trace(gc, VGC_TRACE_COLLECT_BEGIN, vgc_allocation_map_size(gc->allocs), gc->allocs->capacity);
+    }
+    vgc_mark(gc);
+    if (gc->trace) {
+        vgc_trace(gc, VGC_TRACE_MARK_END, vgc_allocation_map_size(gc->allocs), 0);
+    }
+    return vgc_sweep(gc);
+}
+
+/**
+ * A snapshot collection in flight.
+ *
+ * The marker child runs `vgc_mark()` over its copy-on-write view of the heap
+ * and writes the slot numbers of all live but unmarked allocations to a pipe.
+ * Meanwhile the parent starts new allocations out marked, so the slot of an
+ * allocation that was freed and reused since the fork is never swept.
+ *
+ * Weakly referenced and interned garbage is reported first and once more
+ * with the rest. The parent clears the weak references to it and drops it
+ * from the intern table before it frees anything, so that weak lookups and
+ * interning never have to wait for the child.
+ */
+typedef struct vgc_Snapshot {
+#if defined(VGC_SNAPSHOT)
+    pid_t pid;                      // marker child
+    int fd;                         // read end of the pipe
+#endif
+    bool done;                      // the child has reported everything
+    bool weak_cleared;              // no weak reference or interned string is garbage any more
+    size_t freed;                   // bytes freed so far
+    size_t have;                    // bytes of an incomplete slot number in `buf`
+    uint32_t buf[1024];             // slot numbers received
+} vgc_Snapshot;
+
+/* Separates the weakly referenced garbage from the rest in the child's report */
+#define VGC_SNAPSHOT_WEAK_END   UINT32_MAX
+
+#if defined(VGC_SNAPSHOT)
+static bool vgc_write_all(int fd, const void *data, size_t size) {
+    const char *p = (const char *) data;
+    while (size) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+
+/* Off the stack, so stale words in it cannot keep anything alive */
+static uint32_t vgc__snapshot_report[1024];
+
+/**
+ * Queue a slot number for the parent, writing out the queue once it is full.
+ *
+ * @returns `false` if the parent is gone.
+ */
+static bool vgc_snapshot_report(int fd, size_t *n, uint32_t slot) {
+    uint32_t *buf = vgc__snapshot_report;
+    buf[(*n)++] = slot;
+    if (*n == sizeof(vgc__snapshot_report) / sizeof(buf[0])) {
+        *n = 0;
+        return vgc_write_all(fd, buf, sizeof(vgc__snapshot_report));
+    }
+    return true;
+}
+
+/**
+ * Mark the snapshot and report the garbage. Runs in the marker child.
+ */
+static void vgc_snapshot_mark(vgc_GC *gc, int fd) {
+    vgc_AllocationMap *am = gc->allocs;
+    vgc_mark(gc);
+    size_t n = 0;
+    /* The first pass reports the weakly referenced garbage only */
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t word = 0; word < am->page_count * VGC_PAGE_WORDS; ++word) {
+            uint64_t garbage = am->live[word] & ~am->marks[word];
+            while (garbage) {
+                size_t slot = word * 64 + vgc_ctz64(garbage);
+                garbage &= garbage - 1;
+                char tag = am->pages[slot / VGC_PAGE_SLOTS][slot % VGC_PAGE_SLOTS].tag;
+                if (pass == 0 && !(tag & (VGC_TAG_WEAK | VGC_TAG_INTERNED))) {
+                    continue;
+                }
+                if (!vgc_snapshot_report(fd, &n, (uint32_t) slot)) {
+                    return;
+                }
+            }
+        }
+        if (pass == 0 && !vgc_snapshot_report(fd, &n, VGC_SNAPSHOT_WEAK_END)) {
+            return;
+        }
+    }
+    vgc_write_all(fd, vgc__snapshot_report, n * sizeof(uint32_t));
+}
+#endif
+
+bool vgc_snapshot_begin(vgc_GC *gc) {
+#if defined(VGC_SNAPSHOT)
+    if (gc->snapshot) {
+        return false;
+    }
+    /* The marker child only sees registered allocations */
+    vgc_span_flush(gc);
+    vgc_Snapshot *snap = (vgc_Snapshot *) malloc(sizeof(vgc_Snapshot));
+    int fds[2];
+    if (!snap || pipe(fds) != 0) {
+        free(snap);
+        return false;
+    }
+    vgc_AllocationMap *am = gc->allocs;
+    if (am->page_count) {
+        memset(am->marks, 0, am->page_count * VGC_PAGE_WORDS * sizeof(uint64_t));
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        LOG_WARNING("Failed to fork the marker child (errno=%d)", errno);
+        close(fds[0]);
+        close(fds[1]);
+        free(snap);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        vgc_snapshot_mark(gc, fds[1]);
+        /* Skip atexit handlers and stdio buffers, they belong to the parent */
+        _exit(0);
+    }
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    snap->pid = pid;
+    snap->fd = fds[0];
+    snap->done = false;
+    snap->weak_cleared = false;
+    snap->freed = 0;
+    snap->have = 0;
+    /* Allocations made from now on are not part of the snapshot */
+    am->sweeping = true;
+    gc->snapshot = snap;
+    if (gc->trace) {
+        vgc_trace(gc, VGC_TRACE_SNAPSHOT_BEGIN, (uint64_t) pid, 0);
+    }
+    LOG_DEBUG("Forked marker child %d", (int) pid);
+    return true;
+#else
+    (void) gc;
+    return false;
+#endif
+}
+
+/**
+ * Clear the weak references to an allocation the marker child reported as
+ * garbage, unless it was handed out or reused since the fork. An interned
+ * string also leaves the intern table.
+ */
+static void vgc_snapshot_clear_weak(vgc_GC *gc, size_t slot) {
+    vgc_AllocationMap *am = gc->allocs;
+    size_t word = VGC_SLOT_WORD(slot);
+    if (!(am->live[word] & ~am->marks[word] & VGC_SLOT_MASK(slot))) {
+        return;
+    }
+    vgc_Allocation *chunk = &am->pages[slot / VGC_PAGE_SLOTS][slot % VGC_PAGE_SLOTS];
+    if (chunk->tag & VGC_TAG_WEAK) {
+        vgc_weak_forward(gc, chunk->ptr, NULL);
+    }
+    if (chunk->tag & VGC_TAG_INTERNED) {
+        /* Its destructor finds the entry gone later on */
+        vgc_intern_delete(chunk->ptr);
+    }
+}
+
+/**
+ * Keep an object handed out by a weak lookup alive through the snapshot in
+ * flight.
+ *
+ * Until the weak references to garbage are cleared and the intern table is
+ * purged of it, the marker child may count the object as garbage. Marking it keeps it and everything it
+ * references from being swept, like an allocation made since the fork.
+ * Nothing waits for the child.
+ */
+static void vgc_snapshot_retain(vgc_GC *gc, void *ptr) {
+    vgc_Snapshot *snap = gc->snapshot;
+    if (snap && ptr && !snap->weak_cleared) {
+        vgc_mark_alloc(gc, ptr);
+    }
+}
+
+bool vgc_snapshot_poll(vgc_GC *gc) {
+    vgc_Snapshot *snap = gc->snapshot;
+    if (!snap) {
+        return true;
+    }
+#if defined(VGC_SNAPSHOT)
+    while (!snap->done) {
+        ssize_t n = read(snap->fd, (char *) snap->buf + snap->have, sizeof(snap->buf) - snap->have);
+        if (n > 0) {
+            size_t bytes = snap->have + (size_t) n;
+            size_t count = bytes / sizeof(uint32_t);
+            for (size_t i = 0; i < count; ++i) {
+                uint32_t slot = snap->buf[i];
+                if (slot == VGC_SNAPSHOT_WEAK_END) {
+                    snap->weak_cleared = true;
+                } else if (!snap->weak_cleared) {
+                    vgc_snapshot_clear_weak(gc, slot);
+                } else {
+                    snap->freed += vgc_sweep_slot(gc, slot);
+                }
+            }
+            snap->have = bytes % sizeof(uint32_t);
+            memmove(snap->buf, (char *) snap->buf + count * sizeof(uint32_t), snap->have);
+        } else if (n == 0) {
+            snap->done = true;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return false;
+        } else if (errno != EINTR) {
+            /* Everything reported so far was garbage, the rest waits for the next cycle */
+            LOG_WARNING("Lost the marker child's pipe (errno=%d)", errno);
+            snap->done = true;
+        }
+    }
+#endif
+    return true;
+}
+
+size_t vgc_snapshot_end(vgc_GC *gc) {
+    vgc_Snapshot *snap = gc->snapshot;
+    if (!snap) {
+        return 0;
+    }
+#if defined(VGC_SNAPSHOT)
+    fcntl(snap->fd, F_SETFL, fcntl(snap->fd, F_GETFL) & ~O_NONBLOCK);
+    vgc_snapshot_poll(gc);
+    close(snap->fd);
+    while (waitpid(snap->pid, NULL, 0) < 0 && errno == EINTR);
+#endif
+    vgc_AllocationMap *am = gc->allocs;
+    am->sweeping = false;
+    /* unmark everything for the next cycle */
+    if (am->page_count) {
+        memset(am->marks, 0, am->page_count * VGC_PAGE_WORDS * sizeof(uint64_t));
+    }
+    vgc_allocation_map_resize_to_fit(am);
+    size_t freed = snap->freed;
+    free(snap);
+    gc->snapshot = NULL;
+    if (gc->trace) {
+        vgc_trace(gc, VGC_TRACE_SNAPSHOT_END, freed, 0);
+    }
+    return freed;
+}
+
+void vgc_set_snapshot_mode(vgc_GC *gc, bool enabled) {
+    gc->snapshot_mode = enabled;
+}
+
+/**
+ * The dirty page tracker.
+ *
+ * Prefers the kernel's soft-dirty bits: clearing them via
+ * /proc/self/clear_refs starts a new cycle and /proc/self/pagemap reports
+ * which pages have been written since. Where soft-dirty bits are not
+ * available, the pages of all allocations are write-protected instead and
+ * the first write to each of them is caught by a `SIGSEGV` handler, which
+ * records the page and lifts the protection.
+ */
+typedef struct vgc_DirtyTracker {
+    bool soft_dirty;                // kernel soft-dirty bits instead of write protection
+    int pagemap_fd;                 // /proc/self/pagemap (soft-dirty only)
+    size_t page_size;               // system page size
+    uintptr_t *pages;               // protected pages, low bit set once written
+    size_t capacity;                // capacity of `pages` (a power of two)
+} vgc_DirtyTracker;
 
-    // Set the size of a single slot in the array.
-    vgc__array_set_slot_size(array, tsize);
+#if defined(VGC_DIRTY_TRACKING)
+/* The write-protecting tracker the SIGSEGV handler serves */
+static vgc_DirtyTracker *vgc_dirty_active = NULL;
+static struct sigaction vgc_dirty_old_action;
 
-    return array;
+static size_t vgc_dirty_find(const vgc_DirtyTracker *dt, uintptr_t page) {
+    size_t mask = dt->capacity - 1;
+    size_t i = (page / dt->page_size) & mask;
+    while (dt->pages[i] && (dt->pages[i] & ~(uintptr_t) 1) != page) {
+        i = (i + 1) & mask;
+    }
+    return i;
 }
 
-vgc_Buffer * vgc_create_buffer(vgc_GC *gc, size_t size) {
-    return vgc_create_buffer_ext(gc, size, NULL);
+static void vgc_dirty_handler(int sig, siginfo_t *info, void *context) {
+    vgc_DirtyTracker *dt = vgc_dirty_active;
+    if (dt) {
+        uintptr_t page = (uintptr_t) info->si_addr & ~(uintptr_t) (dt->page_size - 1);
+        size_t i = vgc_dirty_find(dt, page);
+        if (dt->pages[i]) {
+            dt->pages[i] = page | 1;
+            mprotect((void *) page, dt->page_size, PROT_READ | PROT_WRITE);
+            return;
+        }
+    }
+    /* Not one of ours, pass it on */
+    if (vgc_dirty_old_action.sa_flags & SA_SIGINFO) {
+        vgc_dirty_old_action.sa_sigaction(sig, info, context);
+    } else if (vgc_dirty_old_action.sa_handler != SIG_DFL && vgc_dirty_old_action.sa_handler != SIG_IGN) {
+        vgc_dirty_old_action.sa_handler(sig);
+    } else {
+        /* Returning faults again, this time with the default action */
+        sigaction(SIGSEGV, &vgc_dirty_old_action, NULL);
+    }
 }
 
-vgc_Buffer * vgc_create_buffer_ext(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
-    // Create a new buffer.
-    vgc_Buffer *buffer = vgcx_new_ext(gc, vgc_Buffer, dtor);
+static bool vgc_dirty_clear_refs(void) {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, "4", 1) == 1;
+    close(fd);
+    return ok;
+}
 
-    // If a destructor was provided:
-    if (dtor == NULL) {
-        // Allocate the buffer's memory.
-        vgc__buffer_set_address(buffer, vgc_malloc(gc, size));
-        vgc__buffer_set_length(buffer, size);
+static bool vgc_dirty_soft_dirty_page(vgc_DirtyTracker *dt, uintptr_t page, bool *dirty) {
+    uint64_t entry;
+    off_t offset = (off_t) (page / dt->page_size * sizeof(uint64_t));
+    if (pread(dt->pagemap_fd, &entry, sizeof(entry), offset) != sizeof(entry)) {
+        return false;
     }
-    // Otherwise:
-    else {
-        // Allocate the buffer's memory.
-        vgc__buffer_set_address(buffer, vgc_malloc_ext(gc, size, dtor));
-        vgc__buffer_set_length(buffer, size);
+    *dirty = (entry >> 55) & 1;
+    return true;
+}
+
+/**
+ * Check that writing to a fresh page sets its soft-dirty bit.
+ */
+static bool vgc_dirty_probe_soft_dirty(vgc_DirtyTracker *dt) {
+    volatile char *probe = (volatile char *) mmap(NULL, dt->page_size, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (probe == (volatile char *) MAP_FAILED) {
+        return false;
     }
+    bool before = true, after = false;
+    probe[0] = 1;
+    bool ok = vgc_dirty_clear_refs()
+              && vgc_dirty_soft_dirty_page(dt, (uintptr_t) probe, &before);
+    probe[0] = 2;
+    ok = ok && vgc_dirty_soft_dirty_page(dt, (uintptr_t) probe, &after);
+    munmap((void *) probe, dt->page_size);
+    return ok && !before && after;
+}
 
-    return buffer;
+/**
+ * Lift the write protection of every page that was not written.
+ */
+static void vgc_dirty_unprotect(vgc_DirtyTracker *dt) {
+    vgc_dirty_active = NULL;
+    if (!dt->pages) {
+        return;
+    }
+    for (size_t i = 0; i < dt->capacity; ++i) {
+        if (dt->pages[i] && !(dt->pages[i] & 1)) {
+            mprotect((void *) dt->pages[i], dt->page_size, PROT_READ | PROT_WRITE);
+        }
+    }
+    munmap(dt->pages, dt->capacity * sizeof(uintptr_t));
+    dt->pages = NULL;
+    dt->capacity = 0;
 }
 
-void * vgc_malloc_static(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
-    void *ptr = vgc_malloc_ext(gc, size, dtor);
-    vgc_make_root(gc, ptr);
-    return ptr;
+/**
+ * Write-protect the pages of all allocations.
+ */
+static void vgc_dirty_protect(vgc_GC *gc, vgc_DirtyTracker *dt) {
+    vgc_AllocationMap *am = gc->allocs;
+    size_t ps = dt->page_size;
+    vgc_dirty_unprotect(dt);
+    size_t count = 0;
+    for (size_t slot = 0; slot < am->slot_count; ++slot) {
+        if (am->live[VGC_SLOT_WORD(slot)] & VGC_SLOT_MASK(slot)) {
+            vgc_Allocation *a = &am->pages[slot / VGC_PAGE_SLOTS][slot % VGC_PAGE_SLOTS];
+            uintptr_t first = (uintptr_t) a->ptr & ~(uintptr_t) (ps - 1);
+            uintptr_t last = ((uintptr_t) a->ptr + (a->size ? a->size - 1 : 0)) & ~(uintptr_t) (ps - 1);
+            count += (last - first) / ps + 1;
+        }
+    }
+    size_t capacity = 64;
+    while (capacity < 2 * count) {
+        capacity *= 2;
+    }
+    /* Kept off the heap, so the handler never writes to a protected page */
+    uintptr_t *pages = (uintptr_t *) mmap(NULL, capacity * sizeof(uintptr_t), PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == (uintptr_t *) MAP_FAILED) {
+        LOG_WARNING("Failed to allocate the dirty page table (%zu pages)", count);
+        return;
+    }
+    dt->pages = pages;
+    dt->capacity = capacity;
+    for (size_t slot = 0; slot < am->slot_count; ++slot) {
+        if (am->live[VGC_SLOT_WORD(slot)] & VGC_SLOT_MASK(slot)) {
+            vgc_Allocation *a = &am->pages[slot / VGC_PAGE_SLOTS][slot % VGC_PAGE_SLOTS];
+            uintptr_t first = (uintptr_t) a->ptr & ~(uintptr_t) (ps - 1);
+            uintptr_t last = ((uintptr_t) a->ptr + (a->size ? a->size - 1 : 0)) & ~(uintptr_t) (ps - 1);
+            for (uintptr_t page = first; page <= last; page += ps) {
+                pages[vgc_dirty_find(dt, page)] = page;
+            }
+        }
+    }
+    vgc_dirty_active = dt;
+    for (size_t i = 0; i < capacity; ++i) {
+        if (pages[i] && mprotect((void *) pages[i], ps, PROT_READ) != 0) {
+            /* Could not protect it, so it cannot be vouched for */
+            pages[i] |= 1;
+        }
+    }
 }
+#endif
 
-void * vgc_make_static(vgc_GC *gc, void *ptr) {
-    vgc_make_root(gc, ptr);
-    return ptr;
+bool vgc_dirty_tracking_start(vgc_GC *gc) {
+#if defined(VGC_DIRTY_TRACKING)
+    if (gc->dirty) {
+        return true;
+    }
+    /* Every allocation has to be touched on its own */
+    if (!vgc_span_retire(gc)) {
+        return false;
+    }
+    vgc_DirtyTracker *dt = (vgc_DirtyTracker *) malloc(sizeof(vgc_DirtyTracker));
+    if (!dt) {
+        return false;
+    }
+    dt->page_size = (size_t) sysconf(_SC_PAGESIZE);
+    dt->pages = NULL;
+    dt->capacity = 0;
+    dt->pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+    dt->soft_dirty = dt->pagemap_fd >= 0 && vgc_dirty_probe_soft_dirty(dt);
+    if (!dt->soft_dirty) {
+        if (dt->pagemap_fd >= 0) {
+            close(dt->pagemap_fd);
+            dt->pagemap_fd = -1;
+        }
+        /* Only one collector at a time can own the SIGSEGV handler */
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = vgc_dirty_handler;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (vgc_dirty_active || sigaction(SIGSEGV, &action, &vgc_dirty_old_action) != 0) {
+            free(dt);
+            return false;
+        }
+    }
+    LOG_DEBUG("Tracking dirty pages with %s", dt->soft_dirty ? "soft-dirty bits" : "write protection");
+    gc->dirty = dt;
+    vgc_dirty_reset(gc);
+    return true;
+#else
+    (void) gc;
+    return false;
+#endif
 }
 
-void * vgc_malloc_ext(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
-    return vgc_allocate(gc, 0, size, dtor);
+void vgc_dirty_tracking_stop(vgc_GC *gc) {
+    vgc_DirtyTracker *dt = gc->dirty;
+    if (!dt) {
+        return;
+    }
+#if defined(VGC_DIRTY_TRACKING)
+    if (dt->soft_dirty) {
+        close(dt->pagemap_fd);
+    } else {
+        vgc_dirty_unprotect(dt);
+        sigaction(SIGSEGV, &vgc_dirty_old_action, NULL);
+    }
+#endif
+    free(dt);
+    gc->dirty = NULL;
 }
 
+/**
+ * Start a new cycle of dirty page tracking.
+ */
+static void vgc_dirty_reset(vgc_GC *gc) {
+#if defined(VGC_DIRTY_TRACKING)
+    vgc_DirtyTracker *dt = gc->dirty;
+    if (!dt) {
+        return;
+    }
+    if (dt->soft_dirty) {
+        vgc_dirty_clear_refs();
+    } else {
+        vgc_dirty_protect(gc, dt);
+    }
+#else
+    (void) gc;
+#endif
+}
 
-void * vgc_calloc(vgc_GC *gc, size_t count, size_t size) {
-    return vgc_calloc_ext(gc, count, size, NULL);
+/**
+ * Count the pages of a new allocation as written.
+ *
+ * A page that was unmapped and mapped again since the last collection is no
+ * longer write-protected, so its writes would go unnoticed otherwise.
+ */
+static void vgc_dirty_touch(vgc_GC *gc, void *ptr, size_t size) {
+#if defined(VGC_DIRTY_TRACKING)
+    vgc_DirtyTracker *dt = gc->dirty;
+    if (!dt || !dt->pages) {
+        return;
+    }
+    uintptr_t first = (uintptr_t) ptr & ~(uintptr_t) (dt->page_size - 1);
+    uintptr_t last = ((uintptr_t) ptr + (size ? size - 1 : 0)) & ~(uintptr_t) (dt->page_size - 1);
+    for (uintptr_t page = first; page <= last; page += dt->page_size) {
+        size_t i = vgc_dirty_find(dt, page);
+        if (dt->pages[i] && !(dt->pages[i] & 1)) {
+            dt->pages[i] |= 1;
+            mprotect((void *) page, dt->page_size, PROT_READ | PROT_WRITE);
+        }
+    }
+#else
+    (void) gc;
+    (void) ptr;
+    (void) size;
+#endif
 }
 
+bool vgc_is_dirty(vgc_GC *gc, const void *ptr, size_t size) {
+#if defined(VGC_DIRTY_TRACKING)
+    vgc_DirtyTracker *dt = gc->dirty;
+    if (!dt) {
+        return true;
+    }
+    uintptr_t first = (uintptr_t) ptr & ~(uintptr_t) (dt->page_size - 1);
+    uintptr_t last = ((uintptr_t) ptr + (size ? size - 1 : 0)) & ~(uintptr_t) (dt->page_size - 1);
+    for (uintptr_t page = first; page <= last; page += dt->page_size) {
+        if (dt->soft_dirty) {
+            bool dirty;
+            if (!vgc_dirty_soft_dirty_page(dt, page, &dirty) || dirty) {
+                return true;
+            }
+        } else {
+            /* Pages we did not protect cannot be vouched for */
+            size_t i = dt->pages ? vgc_dirty_find(dt, page) : 0;
+            if (!dt->pages || !dt->pages[i] || (dt->pages[i] & 1)) {
+                return true;
+            }
+        }
+    }
+    return false;
+#else
+    (void) gc;
+    (void) ptr;
+    (void) size;
+    return true;
+#endif
+}
 
-void * vgc_calloc_ext(vgc_GC *gc, size_t count, size_t size,
-                    vgc_Deconstructor dtor) {
-    return vgc_allocate(gc, count, size, dtor);
+bool vgc_trace_start(vgc_GC *gc, size_t capacity) {
+    if (gc->trace) {
+        return true;
+    }
+    size_t cap = 1;
+    while (cap < capacity) {
+        cap <<= 1;
+    }
+    vgc_TraceBuffer *tb = (vgc_TraceBuffer *) malloc(sizeof(vgc_TraceBuffer));
+    vgc_TraceEvent *events = (vgc_TraceEvent *) calloc(cap, sizeof(vgc_TraceEvent));
+    if (!tb || !events) {
+        free(tb);
+        free(events);
+        return false;
+    }
+    tb->events = events;
+    tb->mask = cap - 1;
+    tb->head = 0;
+    gc->trace = tb;
+    return true;
 }
 
+void vgc_trace_stop(vgc_GC *gc) {
+    vgc_TraceBuffer *tb = gc->trace;
+    if (!tb) {
+        return;
+    }
+    free(tb->events);
+    free(tb);
+    gc->trace = NULL;
+}
 
-void * vgc_realloc(vgc_GC *gc, void *p, size_t size) {
-    vgc_Allocation *alloc = vgc_allocation_map_get(gc->allocs, p);
-    if (p && !alloc) {
-        // the user passed an unknown pointer
-        errno = EINVAL;
-        return NULL;
+size_t vgc_trace_read(vgc_GC *gc, vgc_TraceEvent *events, size_t max) {
+    vgc_TraceBuffer *tb = gc->trace;
+    if (!tb) {
+        return 0;
     }
-    void *q = realloc(p, size);
-    if (!q) {
-        // realloc failed but p is still valid
-        return NULL;
+    size_t head = VGC_ATOMIC_LOAD(tb->head);
+    size_t count = head <= tb->mask ? head : tb->mask + 1;
+    count = count < max ? count : max;
+    /* Skip the oldest events that do not fit, the newest ones are more useful */
+    for (size_t i = 0; i < count; ++i) {
+        events[i] = tb->events[(head - count + i) & tb->mask];
     }
-    if (!p) {
-        // allocation, not reallocation
-        vgc_Allocation *alloc = vgc_allocation_map_put(gc->allocs, q, size, NULL);
-        return alloc->ptr;
+    return count;
+}
+
+bool vgc_trace_dump(vgc_GC *gc, const char *path) {
+    vgc_TraceBuffer *tb = gc->trace;
+    if (!tb) {
+        return false;
     }
-    if (p == q) {
-        // successful reallocation w/o copy
-        alloc->size = size;
-    } else {
-        // successful reallocation w/ copy
-        vgc_Deconstructor dtor = alloc->dtor;
-        vgc_allocation_map_remove(gc->allocs, p, true);
-        vgc_allocation_map_put(gc->allocs, q, size, dtor);
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        LOG_WARNING("Failed to open trace file %s (errno=%d)", path, errno);
+        return false;
     }
-    return q;
+    size_t head = VGC_ATOMIC_LOAD(tb->head);
+    size_t count = head <= tb->mask ? head : tb->mask + 1;
+    bool ok = true;
+    for (size_t i = 0; i < count && ok; ++i) {
+        ok = fwrite(&tb->events[(head - count + i) & tb->mask], sizeof(vgc_TraceEvent), 1, file) == 1;
+    }
+    return fclose(file) == 0 && ok;
 }
 
-void vgc_free(vgc_GC *gc, void *ptr) {
-    vgc_Allocation *alloc = vgc_allocation_map_get(gc->allocs, ptr);
-    if (alloc) {
-        if (alloc->dtor) {
-            alloc->dtor(ptr);
-        }
-        vgc_allocation_map_remove(gc->allocs, ptr, true);
-        free(ptr);
-    } else {
-        LOG_WARNING("Ignoring request to free unknown pointer %p", (void *) ptr);
+bool vgc_record_start(vgc_GC *gc, const char *path, bool edges) {
+#if defined(VGC_THREADS)
+    (void) gc;
+    (void) path;
+    (void) edges;
+    return false;
+#else
+    if (gc->recorder) {
+        return false;
+    }
+    /* Every allocation has to be recorded on its own */
+    if (!vgc_span_retire(gc)) {
+        return false;
+    }
+    vgc_Recorder *rec = (vgc_Recorder *) malloc(sizeof(vgc_Recorder));
+    FILE *file = rec ? fopen(path, "wb") : NULL;
+    if (!file) {
+        LOG_WARNING("Failed to open allocation trace %s (errno=%d)", path, errno);
+        free(rec);
+        return false;
     }
+    rec->file = file;
+    rec->edges = edges;
+    rec->automatic = false;
+    rec->sums = NULL;
+    rec->sum_count = 0;
+    rec->failed = fwrite(VGC_RECORD_MAGIC, sizeof(VGC_RECORD_MAGIC), 1, file) != 1;
+    gc->recorder = rec;
+    return true;
+#endif
 }
 
-void vgc_start(vgc_GC *gc, void *stack_bp) {
-    vgc_start_ext(gc, stack_bp, 1024, 1024, 0.2, 0.8, 0.5);
+bool vgc_record_stop(vgc_GC *gc) {
+    vgc_Recorder *rec = gc->recorder;
+    if (!rec) {
+        return false;
+    }
+    bool ok = fclose(rec->file) == 0 && !rec->failed;
+    if (!ok) {
+        LOG_WARNING("Failed to write the allocation trace%s", "");
+    }
+    free(rec->sums);
+    free(rec);
+    gc->recorder = NULL;
+    return ok;
 }
 
-void vgc_start_ext(vgc_GC *gc,
-                  void *stack_bp,
-                  size_t initial_capacity,
-                  size_t min_capacity,
-                  double downsize_load_factor,
-                  double upsize_load_factor,
-                  double sweep_factor) {
-    double downsize_limit = downsize_load_factor > 0.0 ? downsize_load_factor : 0.2;
-    double upsize_limit = upsize_load_factor > 0.0 ? upsize_load_factor : 0.8;
-    sweep_factor = sweep_factor > 0.0 ? sweep_factor : 0.5;
-    gc->disabled = false;
-    gc->stack_bp = stack_bp;
-    initial_capacity = initial_capacity < min_capacity ? min_capacity : initial_capacity;
-    gc->allocs = vgc_allocation_map_new(min_capacity, initial_capacity,
-                                       sweep_factor, downsize_limit, upsize_limit);
-    LOG_DEBUG("Created new garbage collector (cap=%lld, siz=%lld).", (uint64_t)(gc->allocs->capacity),
-              (uint64_t)(gc->allocs->size));
+/*
+ * Record the start of a collection and, if requested, the pointers of every
+ * live allocation whose contents changed since they were last recorded.
+ * Changes are detected through a checksum per slot, so an unchanged heap
+ * costs one pass over its memory and no output.
+ */
+static void vgc_record_collect(vgc_GC *gc) {
+    vgc_Recorder *rec = gc->recorder;
+    vgc_record(gc, VGC_RECORD_COLLECT, rec->automatic ? VGC_RECORD_AUTO : 0, VGC_RECORD_NONE, 0, VGC_RECORD_NONE);
+    rec->automatic = false;
+    if (!rec->edges) {
+        return;
+    }
+    vgc_AllocationMap *am = gc->allocs;
+    size_t slots = am->page_count * VGC_PAGE_SLOTS;
+    if (slots > rec->sum_count) {
+        uint64_t *sums = (uint64_t *) realloc(rec->sums, slots * sizeof(uint64_t));
+        if (!sums) {
+            rec->failed = true;
+            return;
+        }
+        memset(sums + rec->sum_count, 0, (slots - rec->sum_count) * sizeof(uint64_t));
+        rec->sums = sums;
+        rec->sum_count = slots;
+    }
+    for (size_t word = 0; word < am->page_count * VGC_PAGE_WORDS; ++word) {
+        uint64_t live = am->live[word];
+        while (live) {
+            size_t slot = word * 64 + vgc_ctz64(live);
+            live &= live - 1;
+            vgc_Allocation *alloc = &am->pages[slot / VGC_PAGE_SLOTS][slot % VGC_PAGE_SLOTS];
+            if (alloc->tag & VGC_TAG_NOSCAN) {
+                continue;
+            }
+            void **words = (void **) alloc->ptr;
+            size_t count = alloc->size / VGC_PTRSIZE;
+            uint64_t sum = 0xcbf29ce484222325ull;
+            for (size_t i = 0; i < count; ++i) {
+                sum = (sum ^ (uint64_t) (uintptr_t) words[i]) * 0x100000001b3ull;
+            }
+            sum |= 1;
+            if (rec->sums[slot] == sum) {
+                continue;
+            }
+            rec->sums[slot] = sum;
+            vgc_record(gc, VGC_RECORD_CONTENTS, 0, (uint32_t) slot, alloc->size, VGC_RECORD_NONE);
+            for (size_t i = 0; i < count; ++i) {
+                vgc_Allocation *target = words[i] ? vgc_allocation_map_find(am, words[i]) : NULL;
+                if (target) {
+                    vgc_record(gc, VGC_RECORD_EDGE, 0, (uint32_t) slot, i * VGC_PTRSIZE, target->slot);
+                }
+            }
+        }
+    }
 }
 
-void vgc_disable(vgc_GC *gc) {
-    gc->disabled = true;
+static void vgc_record_realloc(vgc_GC *gc, uint32_t id, void *ptr, size_t size) {
+    vgc_Allocation *alloc = vgc_allocation_map_find(gc->allocs, ptr);
+    if (alloc) {
+        vgc_record(gc, VGC_RECORD_REALLOC, alloc->dtor ? VGC_RECORD_DTOR : 0, alloc->slot, size, id);
+    }
 }
 
-void vgc_enable(vgc_GC *gc) {
-    gc->disabled = false;
+void vgc_add_root_range(vgc_GC *gc, void *begin, void *end) {
+    vgc_RootSet *rs = gc->roots;
+    if (rs->range_count == rs->range_capacity) {
+        size_t capacity = rs->range_capacity ? 2 * rs->range_capacity : 4;
+        vgc_RootRange *ranges = (vgc_RootRange *) realloc(rs->ranges, capacity * sizeof(vgc_RootRange));
+        if (!ranges) {
+            LOG_CRITICAL("Failed to register root range %p-%p", begin, end);
+            return;
+        }
+        rs->ranges = ranges;
+        rs->range_capacity = capacity;
+    }
+    rs->ranges[rs->range_count].begin = begin;
+    rs->ranges[rs->range_count].end = end;
+    rs->range_count++;
 }
 
-void vgc_mark_alloc(vgc_GC *gc, void *ptr) {
-    vgc_Allocation *alloc = vgc_allocation_map_get(gc->allocs, ptr);
-    /* Mark if alloc exists and is not tagged already, otherwise skip */
-    if (alloc && !(alloc->tag & VGC_TAG_MARK)) {
-        LOG_DEBUG("Marking allocation (ptr=%p)", ptr);
-        alloc->tag |= VGC_TAG_MARK;
-        /* Iterate over allocation contents and mark them as well */
-        LOG_DEBUG("Checking allocation (ptr=%p, size=%llu) contents", ptr, alloc->size);
-        for (char *p = (char*) alloc->ptr;
-                p <= (char*) alloc->ptr + alloc->size - VGC_PTRSIZE;
-                ++p) {
-            LOG_DEBUG("Checking allocation (ptr=%p) @%llu with value %p",
-                      ptr, p-((char*) alloc->ptr), *(void **)p);
-            vgc_mark_alloc(gc, *(void **)p);
+void vgc_remove_root_range(vgc_GC *gc, void *begin, void *end) {
+    vgc_RootSet *rs = gc->roots;
+    for (size_t i = 0; i < rs->range_count; ++i) {
+        if (rs->ranges[i].begin == begin && rs->ranges[i].end == end) {
+            rs->ranges[i] = rs->ranges[--rs->range_count];
+            return;
         }
     }
+    LOG_WARNING("Ignoring request to remove unknown root range %p-%p", begin, end);
 }
 
-void vgc_mark_stack(vgc_GC *gc) {
-    LOG_DEBUG("Marking the stack (gc@%p) in increments of %lld", (void *) gc, (uint64_t)(sizeof(char)));
-    void *stack_sp = __builtin_frame_address(0);
-    void *stack_bp = gc->stack_bp;
-    /* The stack grows towards smaller memory addresses, hence we scan stack_sp->stack_bp.
-     * Stop scanning once the distance between stack_sp & stack_bp is too small to hold a valid pointer */
-    for (char *p = (char*) stack_sp; p <= (char*) stack_bp - VGC_PTRSIZE; ++p) {
-        vgc_mark_alloc(gc, *(void **)p);
+void vgc_add_shadow_root(vgc_GC *gc, vgc_ShadowRoot *root) {
+    vgc_RootSet *rs = gc->roots;
+    root->prev = NULL;
+    root->next = rs->shadow;
+    if (rs->shadow) {
+        rs->shadow->prev = root;
     }
+    rs->shadow = root;
 }
 
-void vgc_mark_roots(vgc_GC *gc) {
-    LOG_DEBUG("Marking roots%s", "");
-    for (size_t i = 0; i < gc->allocs->capacity; ++i) {
-        vgc_Allocation *chunk = gc->allocs->allocs[i];
-        while (chunk) {
-            if (chunk->tag & VGC_TAG_ROOT) {
-                LOG_DEBUG("Marking root @ %p", chunk->ptr);
-                vgc_mark_alloc(gc, chunk->ptr);
-            }
-            chunk = chunk->next;
-        }
+void vgc_remove_shadow_root(vgc_GC *gc, vgc_ShadowRoot *root) {
+    vgc_RootSet *rs = gc->roots;
+    if (root->prev) {
+        root->prev->next = root->next;
+    } else if (rs->shadow == root) {
+        rs->shadow = root->next;
+    }
+    if (root->next) {
+        root->next->prev = root->prev;
     }
+    root->prev = NULL;
+    root->next = NULL;
 }
 
-void vgc_mark(vgc_GC *gc) {
-    /* Note: We only look at the stack and the heap, and ignore BSS. */
-    LOG_DEBUG("Initiating GC mark (gc@%p)", (void *) gc);
-    /* Scan the heap for roots */
-    vgc_mark_roots(gc);
-    /* Dump registers onto stack and scan the stack */
-    void (*volatile _mark_stack)(vgc_GC*) = vgc_mark_stack;
+void vgc_add_stack(vgc_GC *gc, vgc_Stack *stack, void *base, void *sp) {
+    stack->base = base;
+    stack->sp = sp;
+    stack->prev = NULL;
+    stack->next = gc->stacks;
+    if (gc->stacks) {
+        gc->stacks->prev = stack;
+    }
+    gc->stacks = stack;
+}
+
+VGC_NOINLINE void vgc_switch_stack(vgc_GC *gc, vgc_Stack *from, vgc_Stack *to) {
+    /* Dump registers onto the suspended stack; together with everything the
+     * caller keeps on its stack they lie above `ctx` */
     jmp_buf ctx;
     memset(&ctx, 0, sizeof(jmp_buf));
     setjmp(ctx);
-    _mark_stack(gc);
+    /* The frame is gone once we return, only its address is kept */
+    void *volatile sp = (void *) &ctx;
+    from->sp = sp;
+    gc->stack_bp = to->base;
 }
 
-size_t vgc_sweep(vgc_GC *gc) {
-    LOG_DEBUG("Initiating GC sweep (gc@%p)", (void *) gc);
-    size_t total = 0;
-    for (size_t i = 0; i < gc->allocs->capacity; ++i) {
-        vgc_Allocation *chunk = gc->allocs->allocs[i];
-        vgc_Allocation *next = NULL;
-        /* Iterate over separate chaining */
-        while (chunk) {
-            if (chunk->tag & VGC_TAG_MARK) {
-                LOG_DEBUG("Found used allocation %p (ptr=%p)", (void *) chunk, (void *) chunk->ptr);
-                /* unmark */
-                chunk->tag &= ~VGC_TAG_MARK;
-                chunk = chunk->next;
-            } else {
-                LOG_DEBUG("Found unused allocation %p (%llu bytes @ ptr=%p)", (void *) chunk, chunk->size, (void *) chunk->ptr);
-                /* no reference to this chunk, hence delete it */
-                total += chunk->size;
-                if (chunk->dtor) {
-                    chunk->dtor(chunk->ptr);
+void vgc_remove_stack(vgc_GC *gc, vgc_Stack *stack) {
+    if (stack->prev) {
+        stack->prev->next = stack->next;
+    } else if (gc->stacks == stack) {
+        gc->stacks = stack->next;
+    }
+    if (stack->next) {
+        stack->next->prev = stack->prev;
+    }
+    stack->prev = NULL;
+    stack->next = NULL;
+}
+
+void vgc_set_stack_scanning(vgc_GC *gc, bool enabled) {
+    gc->scan_stack = enabled;
+}
+
+bool vgc_region_begin(vgc_GC *gc) {
+    vgc_Region *region = (vgc_Region *) malloc(sizeof(vgc_Region));
+    if (!region) {
+        LOG_CRITICAL("Failed to allocate region (gc@%p)", (void *) gc);
+        return false;
+    }
+    region->parent = gc->region;
+    region->spans = NULL;
+    region->index = NULL;
+    region->span_count = 0;
+    region->index_capacity = 0;
+    region->finalizers = NULL;
+    gc->region = region;
+    if (gc->trace) {
+        vgc_trace(gc, VGC_TRACE_REGION_BEGIN, (uint64_t) (uintptr_t) region, 0);
+    }
+    LOG_DEBUG("Entered region %p", (void *) region);
+    return true;
+}
+
+size_t vgc_region_end(vgc_GC *gc) {
+    vgc_Region *region = gc->region;
+    if (!region) {
+        LOG_WARNING("Ignoring request to end a region outside of any region%s", "");
+        return 0;
+    }
+    LOG_DEBUG("Leaving region %p", (void *) region);
+    /* Region objects referenced from roots escape. The stack and unrooted
+     * heap allocations are not traced; objects only referenced from there
+     * have to be promoted explicitly. */
+    if (!vgc_region_promote_roots(gc)) {
+        LOG_CRITICAL("Region objects referenced from roots may not survive region %p", (void *) region);
+    }
+    /* The objects of the enclosing regions outlive this one, so whatever
+     * they reference in it escapes as well. */
+    if (region->spans) {
+        for (vgc_Region *outer = region->parent; outer; outer = outer->parent) {
+            for (vgc_Span *span = outer->spans; span; span = span->next) {
+                if (!vgc_region_promote_range(gc, region, span->data, span->data + span->used)) {
+                    LOG_CRITICAL("Region objects referenced from enclosing regions may not survive region %p",
+                                 (void *) region);
                 }
-                free(chunk->ptr);
-                /* and remove it from the bookkeeping */
-                next = chunk->next;
-                vgc_allocation_map_remove(gc->allocs, chunk->ptr, false);
-                chunk = next;
             }
         }
     }
-    vgc_allocation_map_resize_to_fit(gc->allocs);
-    return total;
-}
-
-/**
- * Unset the ROOT tag on all roots on the heap.
- *
- * @param gc A pointer to a garbage collector instance.
- */
-void vgc_unroot_roots(vgc_GC *gc) {
-    LOG_DEBUG("Unmarking roots%s", "");
-    for (size_t i = 0; i < gc->allocs->capacity; ++i) {
-        vgc_Allocation *chunk = gc->allocs->allocs[i];
-        while (chunk) {
-            if (chunk->tag & VGC_TAG_ROOT) {
-                chunk->tag &= ~VGC_TAG_ROOT;
+    /* Promoted objects may have picked up references to region objects after
+     * their promotion; everything they reference escapes as well. */
+    for (vgc_Span *span = region->spans; span; span = span->next) {
+        if (!span->refs) {
+            continue;
+        }
+        size_t granules = span->used / VGC_SPAN_GRANULE;
+        for (size_t granule = 0; granule < granules; ++granule) {
+            if (!(span->starts[granule / 64] & ((uint64_t) 1 << (granule % 64)))) {
+                continue;
+            }
+            vgc_SpanObject *object = VGC_SPAN_OBJECT_HEADER(span->data + granule * VGC_SPAN_GRANULE);
+            if (object->promoted) {
+                void *ptr = VGC_SPAN_OBJECT_PTR(object);
+                vgc_region_promote_range(gc, NULL, ptr, (char *) ptr + object->size);
             }
-            chunk = chunk->next;
         }
     }
+    /* Finalize everything that stays behind */
+    for (vgc_SpanObject *object = region->finalizers; object; object = object->next) {
+        if (!object->promoted && object->dtor) {
+            object->dtor(VGC_SPAN_OBJECT_PTR(object));
+        }
+    }
+    /* Release the spans in bulk, unless promoted objects still live in them */
+    size_t total = 0;
+    vgc_Span *span = region->spans;
+    while (span) {
+        vgc_Span *next = span->next;
+        span->owned = false;
+        span->next = NULL;
+        if (!span->refs) {
+            total += span->used;
+            free(span);
+        }
+        span = next;
+    }
+    gc->region = region->parent;
+    free(region->index);
+    free(region);
+    if (gc->trace) {
+        vgc_trace(gc, VGC_TRACE_REGION_END, total, 0);
+    }
+    return total;
 }
 
-size_t vgc_stop(vgc_GC *gc) {
-    vgc_unroot_roots(gc);
-    size_t collected = vgc_sweep(gc);
-    vgc_allocation_map_delete(gc->allocs);
-    return collected;
-}
-
-size_t vgc_collect(vgc_GC *gc) {
-    LOG_DEBUG("Initiating GC run (gc@%p)", (void *) gc);
-    vgc_mark(gc);
-    return vgc_sweep(gc);
+void * vgc_region_promote(vgc_GC *gc, void *ptr) {
+    vgc_SpanObject *object = vgc_span_object_get(gc, ptr);
+    if (object && !object->promoted &&
+        !(vgc_region_promote_object(gc, object) && vgc_region_promote_drain(gc))) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    return ptr;
 }
 
 char * vgc_strdup (vgc_GC *gc, const char *str1) {
@@ -685,4 +4193,23 @@ static void vgc__buffer_set_length(vgc_Buffer *buffer, size_t value) {
     * (size_t *)((size_t) struct_bp + VGC_PTRSIZE * 1) = value;
 }
 
+static void vgc__vector_set_scanned(vgc_Vector *vector, bool value) {
+    * (bool *) &vector->scanned = value;
+}
+
+static void vgc__slice_set_parent(vgc_Slice *slice, void * value) {
+    void *struct_bp = (void *) slice;
+    * (void * *)((size_t) struct_bp + VGC_PTRSIZE * 0) = value;
+}
+
+static void vgc__slice_set_address(vgc_Slice *slice, void * value) {
+    void *struct_bp = (void *) slice;
+    * (void * *)((size_t) struct_bp + VGC_PTRSIZE * 1) = value;
+}
+
+static void vgc__slice_set_length(vgc_Slice *slice, size_t value) {
+    void *struct_bp = (void *) slice;
+    * (size_t *)((size_t) struct_bp + VGC_PTRSIZE * 2) = value;
+}
+
 #endif // VGC__VGC_C
@@ -2,7 +2,9 @@
 #define VGC__VGC_CPP
 
 #include <memory>
+#include <stdexcept>
 #include <thread>
+#include <utility>
 
 #include "vgc.hpp"
 
@@ -79,18 +81,18 @@ namespace vgc
     }
 
     template <typename T, typename... Args>
-    T * GarbageCollector::make_managed(Args... args)
+    T * GarbageCollector::make_managed(Args&&... args)
     {
         T *instance = nullptr;
 
         instance = this->malloc_ext<T>();
 
-        return new (instance) T (args...);
+        return new (instance) T (std::forward<Args>(args)...);
     }
 
     void * GarbageCollector::malloc(size_t size)
     {
-        return vgc_malloc(&this->_instance, size);
+        return vgc_malloc_fast(&this->_instance, size, nullptr);
     }
 
     template <typename T>
@@ -106,7 +108,7 @@ namespace vgc
 
     void * GarbageCollector::malloc_ext(size_t size, void (*dtor)(void *))
     {
-        return vgc_malloc_ext(&this->_instance, size, dtor);
+        return vgc_malloc_fast(&this->_instance, size, dtor);
     }
 
     template <typename T>
@@ -116,22 +118,26 @@ namespace vgc
     }
 
     template <typename T>
-    T * GarbageCollector::malloc_ext()
+    void GarbageCollector::destroy(void *memory)
     {
-        void (*dtor)(void *) = [](void *memory) mutable
-        {
-            T *instance = (T *) memory;
-
-            delete instance;
-
-            // T *deconstruction_instance = malloc(&this->_instance, sizeof(T));
+        // The collector owns the memory, only end the object's lifetime.
+        ((T *) memory)->~T();
+    }
 
-            // delete deconstruction_instance;
-        };
+    template <typename T>
+    T * GarbageCollector::malloc_ext()
+    {
+        // Trivial destructors are elided at compile time, so sweeping such objects costs no indirect call.
+        void (*dtor)(void *) = std::is_trivially_destructible<T>::value ? nullptr : &GarbageCollector::destroy<T>;
 
         return (T *) this->malloc_ext(sizeof(T), dtor);
     }
 
+    void * GarbageCollector::malloc_noscan(size_t size)
+    {
+        return vgc_malloc_noscan(&this->_instance, size, NULL);
+    }
+
     void * GarbageCollector::calloc(size_t count, size_t size)
     {
         return vgc_calloc(&this->_instance, count, size);
@@ -155,31 +161,405 @@ namespace vgc
     template <typename T>
     T * GarbageCollector::make_static(T *ptr)
     {
-        return vgc_make_static(&this->_instance, ptr);
+        return (T *) vgc_make_static(&this->_instance, (void *) ptr);
     }
 
     char * GarbageCollector::strdup(const char *s)
     {
         return vgc_strdup(&this->_instance, s);
     }
-}
 
-template <typename T>
-T *vgcpp_new()
-{
-    return VGCPP__NEW(T);
-}
+    const char * GarbageCollector::intern(const char *s)
+    {
+        return vgc_intern(&this->_instance, s);
+    }
 
-int main(int argc, char const *argv[])
-{
-    vgcpp_begin();
+    void GarbageCollector::region_begin()
+    {
+        if (!vgc_region_begin(&this->_instance))
+        {
+            throw std::bad_alloc();
+        }
+    }
 
-    auto x = vgcpp_new<int>();
+    size_t GarbageCollector::region_end()
+    {
+        return vgc_region_end(&this->_instance);
+    }
 
-    vgcpp_end();
+    template <typename T>
+    T * GarbageCollector::promote(T *ptr)
+    {
+        return (T *) vgc_region_promote(&this->_instance, (void *) ptr);
+    }
 
-    return 0;
-}
+    template <typename T>
+    bool GarbageCollector::add_pool(size_t max_bytes)
+    {
+        return vgc_add_pool(&this->_instance, sizeof(T), max_bytes);
+    }
+
+    void GarbageCollector::set_stack_scanning(bool enabled)
+    {
+        vgc_set_stack_scanning(&this->_instance, enabled);
+    }
+
+    /*
+    ** class gc_ptr
+    */
+
+    template <typename T>
+    gc_ptr<T>::gc_ptr(GarbageCollector &gc, T *ptr) : _gc(&gc)
+    {
+        // Register the root.
+        this->_root.ptr = (void *) ptr;
+        vgc_add_shadow_root(&this->_gc->_instance, &this->_root);
+    }
+
+    template <typename T>
+    gc_ptr<T>::gc_ptr(const gc_ptr &other) : gc_ptr(*other._gc, other.get())
+    {
+    }
+
+    template <typename T>
+    gc_ptr<T>::gc_ptr(gc_ptr &&other) noexcept : gc_ptr(*other._gc, other.get())
+    {
+        other._root.ptr = nullptr;
+    }
+
+    template <typename T>
+    gc_ptr<T> & gc_ptr<T>::operator=(const gc_ptr &other)
+    {
+        if (other._gc != this->_gc)
+        {
+            // Move the root over to the other collector.
+            vgc_remove_shadow_root(&this->_gc->_instance, &this->_root);
+            this->_gc = other._gc;
+            vgc_add_shadow_root(&this->_gc->_instance, &this->_root);
+        }
+        this->_root.ptr = other._root.ptr;
+        return *this;
+    }
+
+    template <typename T>
+    gc_ptr<T> & gc_ptr<T>::operator=(T *ptr)
+    {
+        this->_root.ptr = (void *) ptr;
+        return *this;
+    }
+
+    template <typename T>
+    gc_ptr<T>::~gc_ptr()
+    {
+        // Unregister the root.
+        vgc_remove_shadow_root(&this->_gc->_instance, &this->_root);
+    }
+
+    template <typename T>
+    T * gc_ptr<T>::get() const
+    {
+        return (T *) this->_root.ptr;
+    }
+
+    template <typename T>
+    T & gc_ptr<T>::operator*() const
+    {
+        return *this->get();
+    }
+
+    template <typename T>
+    T * gc_ptr<T>::operator->() const
+    {
+        return this->get();
+    }
+
+    template <typename T>
+    gc_ptr<T>::operator bool() const
+    {
+        return this->_root.ptr != nullptr;
+    }
+
+    template <typename T>
+    void gc_ptr<T>::reset(T *ptr)
+    {
+        this->_root.ptr = (void *) ptr;
+    }
+
+    /*
+    ** class allocator
+    */
+
+    template <typename T>
+    allocator<T>::allocator(GarbageCollector &gc) noexcept : _gc(&gc)
+    {
+    }
+
+    template <typename T>
+    template <typename U>
+    allocator<T>::allocator(const allocator<U> &other) noexcept : _gc(other.collector())
+    {
+    }
+
+    template <typename T>
+    T * allocator<T>::allocate(size_type n)
+    {
+        if (n > SIZE_MAX / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        void *ptr = scanned ? this->_gc->malloc(n * sizeof(T)) : this->_gc->malloc_noscan(n * sizeof(T));
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return (T *) ptr;
+    }
+
+    template <typename T>
+    void allocator<T>::deallocate(T *ptr, size_type n) noexcept
+    {
+        (void) n;
+        this->_gc->free((void *) ptr);
+    }
+
+    template <typename T>
+    GarbageCollector * allocator<T>::collector() const noexcept
+    {
+        return this->_gc;
+    }
+
+    template <typename T, typename U>
+    bool operator==(const allocator<T> &a, const allocator<U> &b) noexcept
+    {
+        return a.collector() == b.collector();
+    }
+
+    template <typename T, typename U>
+    bool operator!=(const allocator<T> &a, const allocator<U> &b) noexcept
+    {
+        return !(a == b);
+    }
+
+    /*
+    ** class span_ref
+    */
+
+    template <typename T>
+    span_ref<T>::span_ref() noexcept : _slice(nullptr)
+    {
+    }
+
+    template <typename T>
+    span_ref<T>::span_ref(vgc_Slice *slice) noexcept : _slice(slice)
+    {
+    }
 
+    template <typename T>
+    span_ref<T>::span_ref(GarbageCollector &gc, vgc_Buffer *buffer, size_type first, size_type count)
+    {
+        if (first > buffer->length / sizeof(T) || count > buffer->length / sizeof(T) - first) {
+            throw std::out_of_range("span_ref: range exceeds the buffer");
+        }
+        this->_slice = vgc_create_slice(&gc._instance, buffer, first * sizeof(T), count * sizeof(T));
+        if (!this->_slice) {
+            throw std::bad_alloc();
+        }
+    }
+
+    template <typename T>
+    span_ref<T>::span_ref(GarbageCollector &gc, vgc_Array *array, size_type first, size_type count)
+    {
+        if (first > array->slot_count || count > array->slot_count - first) {
+            throw std::out_of_range("span_ref: range exceeds the array");
+        }
+        this->_slice = vgc_create_array_slice(&gc._instance, array, first, count);
+        if (!this->_slice) {
+            throw std::bad_alloc();
+        }
+    }
+
+    template <typename T>
+    span_ref<T> span_ref<T>::subspan(GarbageCollector &gc, size_type first, size_type count) const
+    {
+        if (first > this->size() || count > this->size() - first) {
+            throw std::out_of_range("span_ref: range exceeds the view");
+        }
+        vgc_Slice *slice = vgc_create_subslice(&gc._instance, this->_slice, first * sizeof(T), count * sizeof(T));
+        if (!slice) {
+            throw std::bad_alloc();
+        }
+        return span_ref(slice);
+    }
+
+    template <typename T>
+    T * span_ref<T>::data() const noexcept
+    {
+        return this->_slice ? (T *) this->_slice->address : nullptr;
+    }
+
+    template <typename T>
+    typename span_ref<T>::size_type span_ref<T>::size() const noexcept
+    {
+        return this->_slice ? this->_slice->length / sizeof(T) : 0;
+    }
+
+    template <typename T>
+    bool span_ref<T>::empty() const noexcept
+    {
+        return this->size() == 0;
+    }
+
+    template <typename T>
+    T & span_ref<T>::operator[](size_type index) const
+    {
+        return this->data()[index];
+    }
+
+    template <typename T>
+    typename span_ref<T>::iterator span_ref<T>::begin() const noexcept
+    {
+        return this->data();
+    }
+
+    template <typename T>
+    typename span_ref<T>::iterator span_ref<T>::end() const noexcept
+    {
+        return this->data() + this->size();
+    }
+
+    template <typename T>
+    vgc_Slice * span_ref<T>::slice() const noexcept
+    {
+        return this->_slice;
+    }
+
+    /*
+    ** class vector
+    */
+
+    template <typename T>
+    vector<T>::vector(GarbageCollector &gc, size_type capacity) : _gc(&gc)
+    {
+        this->_vector = is_pointer_free<T>::value ? vgc_create_vector_noscan(&gc._instance, sizeof(T), capacity)
+                                                  : vgc_create_vector(&gc._instance, sizeof(T), capacity);
+        if (!this->_vector) {
+            throw std::bad_alloc();
+        }
+    }
+
+    template <typename T>
+    void vector<T>::push_back(const T &value)
+    {
+        if (!vgc_vector_push(&this->_gc->_instance, this->_vector, &value)) {
+            throw std::bad_alloc();
+        }
+    }
+
+    template <typename T>
+    void vector<T>::pop_back()
+    {
+        vgc_vector_pop(this->_vector, nullptr);
+    }
+
+    template <typename T>
+    void vector<T>::reserve(size_type capacity)
+    {
+        if (!vgc_vector_reserve(&this->_gc->_instance, this->_vector, capacity)) {
+            throw std::bad_alloc();
+        }
+    }
+
+    template <typename T>
+    void vector<T>::shrink_to_fit()
+    {
+        vgc_vector_shrink(&this->_gc->_instance, this->_vector);
+    }
+
+    template <typename T>
+    void vector<T>::clear() noexcept
+    {
+        vgc_vector_clear(this->_vector);
+    }
+
+    template <typename T>
+    T * vector<T>::data() const noexcept
+    {
+        return (T *) this->_vector->buffer.address;
+    }
+
+    template <typename T>
+    typename vector<T>::size_type vector<T>::size() const noexcept
+    {
+        return this->_vector->array.slot_count;
+    }
+
+    template <typename T>
+    typename vector<T>::size_type vector<T>::capacity() const noexcept
+    {
+        return this->_vector->buffer.length / sizeof(T);
+    }
+
+    template <typename T>
+    bool vector<T>::empty() const noexcept
+    {
+        return this->size() == 0;
+    }
+
+    template <typename T>
+    T & vector<T>::operator[](size_type index) const
+    {
+        return this->data()[index];
+    }
+
+    template <typename T>
+    T & vector<T>::back() const
+    {
+        return this->data()[this->size() - 1];
+    }
+
+    template <typename T>
+    typename vector<T>::iterator vector<T>::begin() const noexcept
+    {
+        return this->data();
+    }
+
+    template <typename T>
+    typename vector<T>::iterator vector<T>::end() const noexcept
+    {
+        return this->data() + this->size();
+    }
+
+    template <typename T>
+    span_ref<T> vector<T>::subspan(size_type first, size_type count) const
+    {
+        return span_ref<T>(*this->_gc, &this->_vector->array, first, count);
+    }
+
+    template <typename T>
+    vgc_Vector * vector<T>::get() const noexcept
+    {
+        return this->_vector;
+    }
+
+    /*
+    ** class Region
+    */
+
+    Region::Region(GarbageCollector &gc) : _gc(gc)
+    {
+        // Begin the region.
+        this->_gc.region_begin();
+    }
+
+    Region::~Region()
+    {
+        // End the region.
+        this->_gc.region_end();
+    }
+
+    template <typename T>
+    T * Region::promote(T *ptr)
+    {
+        return this->_gc.promote(ptr);
+    }
+}
 
 #endif // VGC__VGC_CPP
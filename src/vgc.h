@@ -10,6 +10,11 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#if defined(VGC_THREADS) && !defined(VGC_MAP_STRIPES)
+/// @brief The number of lock stripes of the allocation map.
+#define VGC_MAP_STRIPES 64
+#endif
+
 /// @brief A deconstructor to call after freeing managed memory.
 typedef void (*vgc_Deconstructor)(void *);
 
@@ -22,7 +27,8 @@ typedef void (*vgc_Deconstructor)(void *);
 typedef struct vgc_Allocation {
     void *ptr;                      // mem pointer
     size_t size;                    // allocated size in bytes
-    char tag;                       // the tag for mark-and-sweep
+    char tag;                       // the tag (root, span)
+    uint32_t slot;                  // bit index into the live/mark bitmaps
     vgc_Deconstructor dtor;         // destructor
     struct vgc_Allocation *next;    // separate chaining
 } vgc_Allocation;
@@ -33,6 +39,24 @@ typedef struct vgc_Allocation {
  * The core data structure is a hash map that holds the allocation
  * objects and allows O(1) retrieval given the memory location. Collision
  * resolution is implemented using separate chaining.
+ *
+ * The allocation objects themselves live in pages of fixed size. Every
+ * allocation object owns a slot, and the "live" and "mark" state of all
+ * slots is kept in dense side bitmaps, one 256-bit group per page. This way
+ * sweeping never has to chase the hash chains and clearing the marks for
+ * the next cycle is a single memset.
+ *
+ * Resizing is incremental: the old bucket array stays around until every
+ * one of its buckets has been migrated, `VGC_REHASH_STEP` buckets per insert
+ * or removal, and lookups consult both arrays in the meantime.
+ *
+ * When built with `VGC_THREADS`, inserts and removals lock one of
+ * `VGC_MAP_STRIPES` stripes of buckets and recycle allocation objects
+ * through a free list per stripe, so threads allocating and freeing in
+ * different buckets do not contend. Every stripe also counts the allocations
+ * in its buckets, and the size of the map is the sum of those counters.
+ * Growing the pages or rehashing locks all stripes, and rehashing migrates
+ * all buckets at once. The marker reads the chains without taking any lock.
  */
 typedef struct vgc_AllocationMap {
     size_t capacity;
@@ -41,25 +65,358 @@ typedef struct vgc_AllocationMap {
     double upsize_factor;
     double sweep_factor;
     size_t sweep_limit;
-    size_t size;
     vgc_Allocation **allocs;
+    vgc_Allocation **old_allocs;    // buckets being migrated to `allocs` (or `NULL`)
+    size_t old_capacity;            // capacity of `old_allocs`
+    size_t migrate_index;           // buckets of `old_allocs` below this are migrated
+    vgc_Allocation **pages;         // pages of allocation objects
+    size_t page_count;              // number of pages in use
+    size_t page_capacity;           // capacity of `pages`
+    size_t slot_count;              // slots handed out so far
+#if defined(VGC_THREADS)
+    struct vgc_MapStripe *stripes;  // bucket locks, per-stripe free lists and sizes
+#else
+    size_t size;                    // number of allocations
+    vgc_Allocation *free_list;      // recycled allocation objects
+#endif
+    uint64_t *live;                 // bitmap of slots holding an allocation
+    uint64_t *marks;                // bitmap of marked slots
+    bool sweeping;                  // new allocations start out marked
+    uintptr_t min_ptr;              // lowest managed address seen
+    uintptr_t max_ptr;              // highest managed address seen
 } vgc_AllocationMap;
 
+/// @brief A range of memory that is scanned for references during marking.
+typedef struct vgc_RootRange {
+    void *begin;                    // first byte of the range
+    void *end;                      // one past the last byte of the range
+} vgc_RootRange;
+
+/**
+ * A shadow root.
+ *
+ * Shadow roots are owned by the caller (typically a handle object on the
+ * stack) and linked into the root set while registered. The allocation that
+ * `ptr` points to at collection time is kept alive.
+ */
+typedef struct vgc_ShadowRoot {
+    void *ptr;                      // the referenced allocation (or `NULL`)
+    struct vgc_ShadowRoot *prev;    // previous registered shadow root
+    struct vgc_ShadowRoot *next;    // next registered shadow root
+} vgc_ShadowRoot;
+
+/**
+ * An additional stack (e.g. of a fiber or coroutine).
+ *
+ * Stacks are owned by the caller and linked into the collector while
+ * registered. A suspended stack is scanned from its saved stack pointer up
+ * to its base; the running stack is scanned like the main stack.
+ */
+typedef struct vgc_Stack {
+    void *base;                     // one past the highest address of the stack
+    void *sp;                       // saved stack pointer (or `NULL` if not started)
+    struct vgc_Stack *prev;         // previous registered stack
+    struct vgc_Stack *next;         // next registered stack
+} vgc_Stack;
+
+/**
+ * A weak reference.
+ *
+ * Weak references are managed objects themselves. Their target is cleared
+ * when it is collected or freed, and they unregister themselves when they
+ * are collected.
+ */
+typedef struct vgc_WeakRef {
+    void *target;                   // the referenced allocation (or `NULL` once collected)
+    struct vgc_GC *gc;              // the owning garbage collector
+    struct vgc_WeakRef *prev;       // previous registered weak reference
+    struct vgc_WeakRef *next;       // next registered weak reference
+} vgc_WeakRef;
+
+/**
+ * An ephemeron map: each value is kept alive for as long as its key is
+ * reachable, and entries are dropped when their key is collected.
+ */
+typedef struct vgc_WeakMap vgc_WeakMap;
+
+/**
+ * A recycling pool for allocations of one size.
+ *
+ * Swept or freed allocations of exactly `size` bytes are kept on the free
+ * list (linked through their first word) instead of being returned to the
+ * system, and new allocations of that size are served from it first.
+ */
+typedef struct vgc_Pool {
+    size_t size;                    // size of the pooled blocks in bytes
+    size_t count;                   // number of pooled blocks
+    size_t max_count;               // maximum number of pooled blocks
+    void *free_list;                // pooled blocks
+} vgc_Pool;
+
+/**
+ * The root set.
+ *
+ * Explicit roots (static allocations) are kept in a compact index of their
+ * own, so marking them costs O(roots) instead of a walk over the entire
+ * allocation map. Registered root ranges (data segments, foreign buffers)
+ * are scanned conservatively on every collection. Shadow roots are precise
+ * and can be registered and unregistered in O(1).
+ */
+typedef struct vgc_RootSet {
+    void **roots;                   // pointers to the root allocations
+    size_t size;                    // number of roots
+    size_t capacity;                // capacity of `roots`
+    vgc_RootRange *ranges;          // registered root ranges
+    size_t range_count;             // number of root ranges
+    size_t range_capacity;          // capacity of `ranges`
+    vgc_ShadowRoot *shadow;         // registered shadow roots, newest first
+} vgc_RootSet;
+
+/**
+ * A span of bump-allocated memory.
+ *
+ * Spans back regions: objects are carved out of a span by bumping `used`
+ * and are released all at once together with the span. A bitmap records
+ * where objects start so that arbitrary words can be validated as object
+ * pointers. Objects that escape their region are promoted into the
+ * allocation map and keep their span alive through `refs`.
+ *
+ * Outside regions, allocations are bumped from the collector's allocation
+ * span. Its objects are registered in the allocation map in batches, and
+ * `registered` tracks how far that has got.
+ */
+typedef struct vgc_Span {
+    struct vgc_Span *next;          // span list of the owning region
+    char *data;                     // first byte of object memory
+    size_t capacity;                // object memory in bytes
+    size_t used;                    // bytes handed out so far
+    size_t refs;                    // promoted objects still alive
+    bool owned;                     // still owned by a region or the collector
+    size_t registered;              // bytes whose objects are in the allocation map
+    uint64_t *starts;               // object start bitmap (one bit per granule)
+} vgc_Span;
+
+/**
+ * A region.
+ *
+ * While a region is active, all allocations are bump-allocated from its
+ * spans instead of being tracked in the allocation map. Ending the region
+ * releases all of them at once. The spans are also indexed by address, so
+ * that words can be resolved to region objects by binary search.
+ */
+typedef struct vgc_Region {
+    struct vgc_Region *parent;              // enclosing region
+    struct vgc_Span *spans;                 // spans, current one first
+    struct vgc_Span **index;                // spans sorted by address
+    size_t span_count;                      // number of spans
+    size_t index_capacity;                  // capacity of `index`
+    struct vgc_SpanObject *finalizers;      // objects that have a destructor
+} vgc_Region;
+
+/*
+ * Spans hand out memory in granules of two pointers, which keeps every
+ * object suitably aligned for any fundamental type.
+ */
+#define VGC_SPAN_GRANULE (2 * sizeof(void *))
+
+/**
+ * The header in front of every object in a span.
+ */
+typedef struct vgc_SpanObject {
+    vgc_Span *span;                     // owning span
+    size_t size;                        // object size in bytes
+    vgc_Deconstructor dtor;             // destructor
+    struct vgc_SpanObject *next;        // finalizer list of the region
+    bool promoted;                      // handed over to the allocation map
+} vgc_SpanObject;
+
+#define VGC_SPAN_OBJECT_PTR(object)     ((void *) ((vgc_SpanObject *) (object) + 1))
+#define VGC_SPAN_OBJECT_HEADER(ptr)     ((vgc_SpanObject *) (ptr) - 1)
+
+/**
+ * Bump-allocate an object from a span.
+ *
+ * @param span The span to allocate from.
+ * @param size The size of the object in bytes.
+ * @param alignment The alignment of the object (a power of two, at least
+ *                  one granule).
+ * @returns A pointer to the object header, or `NULL` if the span is full.
+ */
+static inline vgc_SpanObject * vgc_span_bump(vgc_Span *span, size_t size, size_t alignment) {
+    uintptr_t start = (uintptr_t) (span->data + span->used) + sizeof(vgc_SpanObject);
+    char *ptr = (char *) ((start + alignment - 1) & ~(uintptr_t) (alignment - 1));
+    char *end = ptr + ((size + VGC_SPAN_GRANULE - 1) & ~(VGC_SPAN_GRANULE - 1));
+    if (size > span->capacity || end > span->data + span->capacity) {
+        return NULL;
+    }
+    span->used = (size_t) (end - span->data);
+    size_t granule = (size_t) (ptr - span->data) / VGC_SPAN_GRANULE;
+    span->starts[granule / 64] |= (uint64_t) 1 << (granule % 64);
+    vgc_SpanObject *object = VGC_SPAN_OBJECT_HEADER(ptr);
+    object->span = span;
+    object->size = size;
+    object->dtor = NULL;
+    object->next = NULL;
+    object->promoted = false;
+    return object;
+}
+
+#if !defined(VGC_PREFETCH_DEPTH)
+/// @brief The number of candidate pointers the marker prefetches ahead (0 disables prefetching).
+#define VGC_PREFETCH_DEPTH 8
+#endif
+
+/**
+ * The mark queue.
+ *
+ * Candidate pointers found while scanning first pass through a small FIFO.
+ * Their hash bucket is prefetched when they enter it, so by the time they
+ * leave it the lookup hits the cache. Allocations that get marked are pushed
+ * onto the gray stack, and their contents are prefetched until they are
+ * scanned.
+ */
+typedef struct vgc_MarkQueue {
+    void *fifo[VGC_PREFETCH_DEPTH > 0 ? VGC_PREFETCH_DEPTH : 1];  // candidate ring buffer
+    size_t head;                    // index of the oldest candidate
+    size_t count;                   // number of candidates in the ring
+    vgc_Allocation **gray;          // marked allocations awaiting a scan
+    size_t gray_size;               // number of gray allocations
+    size_t gray_capacity;           // capacity of `gray`
+} vgc_MarkQueue;
+
 /// @brief A garbage collector, used to manage memory.
 typedef struct vgc_GC {
     /// @brief The allocation map.
     struct vgc_AllocationMap *allocs;
 
+    /// @brief The root set.
+    struct vgc_RootSet *roots;
+
+    /// @brief The mark queue.
+    struct vgc_MarkQueue *mark_queue;
+
     /// @brief Toggling this variable will (temporarily) switch gc on/off.
     bool disabled;
 
+    /// @brief Scan the stack and registers for references (on by default).
+    bool scan_stack;
+
     /// @brief A pointer to the bottom of managed stack.
     void *stack_bp;
 
+    /// @brief Additional registered stacks (or `NULL`).
+    struct vgc_Stack *stacks;
+
     /// @brief The minimum size of the managed heap.
     size_t min_size;
+
+    /// @brief The innermost active region (or `NULL`).
+    struct vgc_Region *region;
+
+    /// @brief The span that allocations outside regions are bumped from (or `NULL`).
+    struct vgc_Span *span;
+
+    /// @brief The snapshot collection in flight (or `NULL`).
+    struct vgc_Snapshot *snapshot;
+
+    /// @brief Collect automatically through snapshots instead of pausing (Linux only).
+    bool snapshot_mode;
+
+    /// @brief The dirty page tracker (or `NULL`).
+    struct vgc_DirtyTracker *dirty;
+
+    /// @brief Registered weak references (or `NULL`).
+    struct vgc_WeakRef *weak_refs;
+
+    /// @brief Registered weak maps (or `NULL`).
+    struct vgc_WeakMap *weak_maps;
+
+    /// @brief Recycling pools, one per pooled size.
+    vgc_Pool *pools;
+
+    /// @brief The number of recycling pools.
+    size_t pool_count;
+
+    /// @brief The event trace buffer (or `NULL`).
+    struct vgc_TraceBuffer *trace;
+
+    /// @brief The allocation recorder (or `NULL`).
+    struct vgc_Recorder *recorder;
+
+    /// @brief The string interning table (or `NULL`).
+    struct vgc_InternTable *interns;
 } vgc_GC;
 
+/// @brief The kinds of events recorded in a trace.
+typedef enum vgc_TraceEventType {
+    VGC_TRACE_COLLECT_BEGIN = 1,    // a = allocations tracked, b = map capacity
+    VGC_TRACE_MARK_END,             // a = allocations tracked
+    VGC_TRACE_SWEEP_END,            // a = bytes freed, b = allocations left
+    VGC_TRACE_SNAPSHOT_BEGIN,       // a = pid of the marker child
+    VGC_TRACE_SNAPSHOT_END,         // a = bytes freed
+    VGC_TRACE_REGION_BEGIN,         // a = region address
+    VGC_TRACE_REGION_END,           // a = bytes released
+} vgc_TraceEventType;
+
+/// @brief A fixed-size binary trace record.
+typedef struct vgc_TraceEvent {
+    /// @brief Wall-clock time of the event *(in nanoseconds)*.
+    uint64_t time;
+
+    /// @brief The event type (a `vgc_TraceEventType`).
+    uint32_t type;
+
+    /// @brief Event-specific arguments.
+    uint64_t a, b;
+} vgc_TraceEvent;
+
+/// @brief The kinds of events in a recorded allocation trace.
+typedef enum vgc_RecordType {
+    VGC_RECORD_MALLOC = 1,          // id = new object, size = bytes
+    VGC_RECORD_CALLOC,              // id = new object, size = bytes (zeroed)
+    VGC_RECORD_REALLOC,             // id = resized object, size = bytes, arg = previous id
+    VGC_RECORD_FREE,                // id = freed object, size = bytes
+    VGC_RECORD_COLLECT,             // a collection starts
+    VGC_RECORD_CONTENTS,            // id = object that changed since the last collection, size = bytes; its edges follow
+    VGC_RECORD_EDGE,                // id = source object, size = byte offset, arg = target object
+    VGC_RECORD_SWEEP,               // id = object swept as garbage, size = bytes
+} vgc_RecordType;
+
+/// @brief The object has a destructor.
+#define VGC_RECORD_DTOR 0x1
+
+/// @brief The collection was triggered by an allocation.
+#define VGC_RECORD_AUTO 0x2
+
+/// @brief The id of no object.
+#define VGC_RECORD_NONE UINT32_MAX
+
+/// @brief The magic bytes at the start of a recorded allocation trace.
+#define VGC_RECORD_MAGIC "VGCREC1"
+
+/// @brief A fixed-size record of a recorded allocation trace.
+/// @details Objects are identified by the slot of their allocation object, which is unique among live objects and reused once they die.
+typedef struct vgc_RecordEvent {
+    /// @brief The event type (a `vgc_RecordType`).
+    uint8_t type;
+
+    /// @brief `VGC_RECORD_DTOR` and `VGC_RECORD_AUTO` flags.
+    uint8_t flags;
+
+    uint16_t reserved;
+
+    /// @brief The object the event applies to.
+    uint32_t id;
+
+    /// @brief The size of the object, or the offset of an edge *(in bytes)*.
+    uint64_t size;
+
+    /// @brief The previous id of a reallocated object, or the target of an edge.
+    uint32_t arg;
+
+    uint32_t reserved2;
+} vgc_RecordEvent;
+
 /// @brief A managed buffer of RAM.
 typedef struct vgc_Buffer {
     /// @brief The address where the buffer's data is stored in memory.
@@ -81,23 +438,113 @@ typedef struct vgc_Array {
     const size_t slot_size;
 } vgc_Array;
 
+/// @brief A managed array that grows as items are appended.
+/// @details `array` covers the items in use, so `array.slot_count` is the length of the vector and
+///          `array.slot_size` the size of an item. Its buffer covers the whole storage, so
+///          `buffer.length / array.slot_size` is the capacity. The storage may move when the vector grows.
+typedef struct vgc_Vector {
+    /// @brief The items in use.
+    vgc_Array array;
+
+    /// @brief The storage of the vector.
+    vgc_Buffer buffer;
+
+    /// @brief Whether the storage is scanned for references.
+    const bool scanned;
+} vgc_Vector;
+
+/// @brief A managed view of part of a buffer or an array.
+/// @details Pointers into the middle of a payload do not keep it alive; a slice
+///          references its parent header instead, so the parent survives for as
+///          long as the slice is reachable.
+typedef struct vgc_Slice {
+    /// @brief The buffer or array the slice points into.
+    void * const parent;
+
+    /// @brief The address of the first byte of the slice.
+    void * const address;
+
+    /// @brief The length of the slice *(in bytes)*.
+    const size_t length;
+} vgc_Slice;
+
 /// @brief A global instance of the garbage collector for use by single-threaded applications.
 extern vgc_GC *VGC_GLOBAL_GC;
 
 #if !defined(vgc__libc_free)
 /// @brief The C standard library function `free`.
-void (*vgc__libc_free)(void *block) = free;
+extern void (*vgc__libc_free)(void *block);
 #endif
 
 #if !defined(vgc__libc_malloc)
 /// @brief The C standard library function `malloc`.
-void * (*vgc__libc_malloc)(size_t size) = malloc;
+extern void * (*vgc__libc_malloc)(size_t size);
 #endif
 
 /// @brief Run the garbage collector, freeing up any unreachable memory resources that are no longer being used.
 /// @return The amount of memory freed (in bytes).
 size_t vgc_collect(vgc_GC *gc);
 
+/// @brief Start a snapshot collection: a forked child marks a copy-on-write snapshot of the heap while the caller keeps running (Linux only).
+/// @details Allocations made while the snapshot is in flight are treated as live.
+/// @return `true` if the marker child was started.
+bool vgc_snapshot_begin(vgc_GC *gc);
+
+/// @brief Free the unreachable allocations the marker child has reported so far, without blocking.
+/// @return `true` once the marker child has reported everything (or no snapshot is in flight).
+bool vgc_snapshot_poll(vgc_GC *gc);
+
+/// @brief Wait for the snapshot collection in flight to complete.
+/// @return The amount of memory freed by the snapshot collection (in bytes).
+size_t vgc_snapshot_end(vgc_GC *gc);
+
+/// @brief Let automatic collections run as snapshot collections (`true`) or stop the world (`false`).
+void vgc_set_snapshot_mode(vgc_GC *gc, bool enabled);
+
+/// @brief Start recording which heap pages are written between collections (Linux only).
+/// @details Uses the kernel's soft-dirty page bits where available and write protection plus a `SIGSEGV` handler otherwise.
+/// With write protection, system calls that write into managed memory that has not been written since the last collection (e.g. `read()`) fail with `EFAULT`.
+/// @return `true` if tracking is active.
+bool vgc_dirty_tracking_start(vgc_GC *gc);
+
+/// @brief Stop recording which heap pages are written.
+void vgc_dirty_tracking_stop(vgc_GC *gc);
+
+/// @brief Start recording collector events into a ring buffer, which keeps the most recent `capacity` events.
+/// @details Recording costs a timestamp and a store per event, with no formatting or I/O.
+/// @param capacity The number of events to keep (rounded up to a power of two).
+/// @return `true` if tracing is active.
+bool vgc_trace_start(vgc_GC *gc, size_t capacity);
+
+/// @brief Stop recording events and release the trace buffer.
+void vgc_trace_stop(vgc_GC *gc);
+
+/// @brief Copy the most recent recorded events, oldest first.
+/// @param events Receives up to `max` events.
+/// @return The number of events copied.
+size_t vgc_trace_read(vgc_GC *gc, vgc_TraceEvent *events, size_t max);
+
+/// @brief Write the recorded events, oldest first, as raw `vgc_TraceEvent` records to a file.
+/// @return `true` on success.
+bool vgc_trace_dump(vgc_GC *gc, const char *path);
+
+/// @brief Start recording every allocation, reallocation, free and collection to a file, for replay with `test/replay.c`.
+/// @details The file starts with `VGC_RECORD_MAGIC` (including its terminator), followed by `vgc_RecordEvent` records.
+/// Not available with `VGC_THREADS`.
+/// @param path The file to write.
+/// @param edges Also record the pointers of every object that changed since the previous collection, when a collection starts.
+/// Finding the changed objects costs about as much as marking the heap.
+/// @return `true` if recording started.
+bool vgc_record_start(vgc_GC *gc, const char *path, bool edges);
+
+/// @brief Stop recording and close the file.
+/// @return `true` if every event was written.
+bool vgc_record_stop(vgc_GC *gc);
+
+/// @brief Check whether any page of a range of memory was written since the last collection.
+/// @details Without dirty page tracking every range counts as dirty.
+bool vgc_is_dirty(vgc_GC *gc, const void *ptr, size_t size);
+
 /// @brief Disable garbage collection.
 void vgc_disable(vgc_GC *gc);
 
@@ -144,6 +591,45 @@ void * vgc_malloc_static(vgc_GC *gc, size_t size, vgc_Deconstructor dtor);
 /// @return A pointer to the allocated managed memory.
 void * vgc_malloc_ext(vgc_GC *gc, size_t size, vgc_Deconstructor dtor);
 
+/// @brief Allocate a block of managed memory through the inline fast path.
+/// @details The block is bump-allocated from the current region's span, or outside regions from the allocation span,
+/// without leaving the caller. `vgc_malloc_ext()` is only called when the span is exhausted, which is also when a
+/// collection may be triggered.
+/// @param gc The garbage collector to use.
+/// @param size The size of the block of managed memory *(in bytes)* to allocate.
+/// @param dtor The deconstructor to call after freeing the managed memory.
+/// @return A pointer to the allocated managed memory.
+static inline void * vgc_malloc_fast(vgc_GC *gc, size_t size, vgc_Deconstructor dtor) {
+    vgc_Region *region = gc->region;
+    vgc_Span *span = region ? region->spans : gc->span;
+    vgc_SpanObject *object = span ? vgc_span_bump(span, size, VGC_SPAN_GRANULE) : NULL;
+    if (!object) {
+        return vgc_malloc_ext(gc, size, dtor);
+    }
+    object->dtor = dtor;
+    if (dtor && region) {
+        object->next = region->finalizers;
+        region->finalizers = object;
+    }
+    return VGC_SPAN_OBJECT_PTR(object);
+}
+
+/// @brief Allocate a block of managed memory that holds no pointers to managed memory.
+/// @details The block is kept alive like any other allocation but is never scanned for references.
+/// @param gc The garbage collector to use.
+/// @param size The size of the block of managed memory *(in bytes)* to allocate.
+/// @param dtor The deconstructor to call after freeing the managed memory.
+/// @return A pointer to the allocated managed memory.
+void * vgc_malloc_noscan(vgc_GC *gc, size_t size, vgc_Deconstructor dtor);
+
+/// @brief Recycle allocations of one size instead of returning them to the system.
+/// @details Adding a pool for a size that already has one updates its limit. Pools are not available with `VGC_THREADS`.
+/// @param gc The garbage collector to use.
+/// @param size The size of the pooled allocations *(in bytes, at least the size of a pointer)*.
+/// @param max_bytes The maximum number of bytes the pool may hold on to.
+/// @return `true` on success.
+bool vgc_add_pool(vgc_GC *gc, size_t size, size_t max_bytes);
+
 /// @brief Allocate multiple blocks of managed memory.
 /// @param gc The garbage collector to use.
 /// @param count The number of blocks to allocate.
@@ -177,12 +663,145 @@ void vgc_free(vgc_GC *gc, void *ptr);
 /// @return A pointer to the managed memory.
 void *vgc_make_static(vgc_GC *gc, void *ptr);
 
+/// @brief Begin a region.
+///
+/// Until the matching `vgc_region_end()`, allocations are bump-allocated from
+/// the region instead of being tracked individually. Regions nest.
+/// @param gc The garbage collector to use.
+/// @return `true` on success; no region is entered otherwise.
+bool vgc_region_begin(vgc_GC *gc);
+
+/// @brief End the innermost region, releasing every object allocated in it
+/// that has not been promoted.
+///
+/// Region objects referenced from roots, root ranges, shadow roots and the
+/// objects of enclosing regions are promoted automatically. References from
+/// the stack or from heap allocations that are not roots are not traced;
+/// objects only reachable from there must be passed to `vgc_region_promote()`
+/// before the region ends.
+/// @param gc The garbage collector to use.
+/// @return The number of bytes released.
+size_t vgc_region_end(vgc_GC *gc);
+
+/// @brief Promote an object out of its region.
+///
+/// The object, and every region object reachable from it, is handed over to
+/// the collector and survives the end of its region. Pointers to memory that
+/// is not a region object are returned unchanged.
+/// @param gc The garbage collector to use.
+/// @param ptr A pointer to the region object.
+/// @return `ptr`, or `NULL` if the collector ran out of memory.
+void * vgc_region_promote(vgc_GC *gc, void *ptr);
+
+/// @brief Register a range of memory to be scanned for references on every collection.
+///
+/// Use this for data segments, thread-local storage or buffers that were not
+/// allocated by the garbage collector.
+/// @param gc The garbage collector to use.
+/// @param begin The first byte of the range.
+/// @param end One past the last byte of the range.
+void vgc_add_root_range(vgc_GC *gc, void *begin, void *end);
+
+/// @brief Unregister a range of memory previously passed to `vgc_add_root_range()`.
+/// @param gc The garbage collector to use.
+/// @param begin The first byte of the range.
+/// @param end One past the last byte of the range.
+void vgc_remove_root_range(vgc_GC *gc, void *begin, void *end);
+
+/// @brief Register a shadow root. Whatever `root->ptr` points to at collection time is kept alive.
+/// @param gc The garbage collector to use.
+/// @param root The shadow root, which must stay valid until it is removed.
+void vgc_add_shadow_root(vgc_GC *gc, vgc_ShadowRoot *root);
+
+/// @brief Unregister a shadow root previously passed to `vgc_add_shadow_root()`.
+/// @param gc The garbage collector to use.
+/// @param root The shadow root.
+void vgc_remove_shadow_root(vgc_GC *gc, vgc_ShadowRoot *root);
+
+/// @brief Register an additional stack.
+/// @param gc The garbage collector to use.
+/// @param stack The stack, which must stay valid until it is removed.
+/// @param base One past the highest address of the stack *(stacks grow downwards)*.
+/// @param sp The saved stack pointer, or `NULL` if the stack holds nothing yet.
+void vgc_add_stack(vgc_GC *gc, vgc_Stack *stack, void *base, void *sp);
+
+/// @brief Tell the collector that execution is about to switch from one registered stack to another.
+/// @details Call this on the `from` stack right before the switch. `from` is suspended at the caller's frame, with the registers spilled below it, and `to` becomes the stack that is scanned from the live stack pointer.
+/// @param gc The garbage collector to use.
+/// @param from The running stack.
+/// @param to The stack to switch to.
+void vgc_switch_stack(vgc_GC *gc, vgc_Stack *from, vgc_Stack *to);
+
+/// @brief Unregister a stack previously passed to `vgc_add_stack()`.
+/// @param gc The garbage collector to use.
+/// @param stack The stack.
+void vgc_remove_stack(vgc_GC *gc, vgc_Stack *stack);
+
+/// @brief Enable or disable conservative scanning of the stack and registers.
+/// @details With stack scanning disabled, only roots, root ranges, shadow roots and active regions keep allocations alive.
+void vgc_set_stack_scanning(vgc_GC *gc, bool enabled);
+
+/// @brief Create a weak reference, which does not keep its target alive.
+/// @param gc The garbage collector to use.
+/// @param target A pointer to a managed allocation *(not a region object)*, or `NULL`.
+/// @return A pointer to the managed weak reference, or `NULL` if `target` is not managed or allocation failed.
+vgc_WeakRef * vgc_create_weak_ref(vgc_GC *gc, void *target);
+
+/// @brief Get the target of a weak reference.
+/// @param ref The weak reference.
+/// @return The target, or `NULL` if it has been collected or freed.
+void * vgc_weak_ref_get(const vgc_WeakRef *ref);
+
+/// @brief Create an ephemeron map, which keeps each value alive only while its key is reachable.
+/// @details The map is a managed object; its entries are dropped when their key is collected or freed.
+/// @param gc The garbage collector to use.
+/// @return A pointer to the managed map, or `NULL` if allocation failed.
+vgc_WeakMap * vgc_create_weak_map(vgc_GC *gc);
+
+/// @brief Insert or replace an entry.
+/// @param map The map.
+/// @param key A pointer to a managed allocation *(not a region object)*.
+/// @param value The value to associate with `key`.
+/// @return `true` on success, `false` if `key` is not managed or allocation failed.
+bool vgc_weak_map_put(vgc_WeakMap *map, void *key, void *value);
+
+/// @brief Look up the value associated with a key.
+/// @param map The map.
+/// @param key The key.
+/// @return The value, or `NULL` if the map holds no entry for `key`.
+void * vgc_weak_map_get(const vgc_WeakMap *map, const void *key);
+
+/// @brief Remove an entry.
+/// @param map The map.
+/// @param key The key.
+/// @return `true` if an entry was removed.
+bool vgc_weak_map_remove(vgc_WeakMap *map, const void *key);
+
+/// @brief Get the number of entries.
+/// @param map The map.
+/// @return The number of entries.
+size_t vgc_weak_map_size(const vgc_WeakMap *map);
+
 /// @brief Returns a pointer to a null-terminated byte string, which is a duplicate of the string pointed to by `str1`.
 /// @param gc The garbage collector to use.
 /// @param str1 The string to duplicate.
 /// @return A duplicate of `str1`.
 char * vgc_strdup(vgc_GC *gc, const char *str1);
 
+/// @brief Get the shared managed copy of a string.
+/// @details Equal strings are interned once. The table holds its strings weakly, so an interned string is
+///          collected like any other allocation once nothing references it. Interned strings are shared and must
+///          not be modified; `vgc_free()` ignores them and `vgc_realloc()` fails with `EINVAL`.
+/// @param gc The garbage collector to use.
+/// @param str The string to intern.
+/// @return The interned string, or `NULL` if allocation failed.
+const char * vgc_intern(vgc_GC *gc, const char *str);
+
+/// @brief Get the number of interned strings.
+/// @param gc The garbage collector to use.
+/// @return The number of strings in the interning table.
+size_t vgc_intern_count(vgc_GC *gc);
+
 /// @brief Create a managed array.
 /// @param gc The garbage collector to use.
 /// @param tsize The size of an item contained within the array.
@@ -211,6 +830,151 @@ vgc_Buffer * vgc_create_buffer(vgc_GC *gc, size_t size);
 /// @return A pointer to the allocated managed buffer.
 vgc_Buffer * vgc_create_buffer_ext(vgc_GC *gc, size_t size, vgc_Deconstructor dtor);
 
+/// @brief Create a compact managed array.
+///
+/// The array header, its buffer header and the payload live in a single
+/// managed block, with the payload aligned to a cache line. The array only
+/// costs one allocation map entry and `array->buffer->address` stays valid.
+/// @param gc The garbage collector to use.
+/// @param tsize The size of an item contained within the array.
+/// @param count The number of items the managed array can hold.
+/// @return A pointer to the allocated managed array.
+vgc_Array * vgc_create_compact_array(vgc_GC *gc, size_t tsize, size_t count);
+
+/// @brief Create a compact managed array.
+/// @param gc The garbage collector to use.
+/// @param tsize The size of an item contained within the array.
+/// @param count The number of items the managed array can hold.
+/// @param dtor The deconstructor to call (with the array) after freeing the managed memory.
+/// @return A pointer to the allocated managed array.
+vgc_Array * vgc_create_compact_array_ext(vgc_GC *gc, size_t tsize, size_t count, vgc_Deconstructor dtor);
+
+/// @brief Create a compact managed buffer.
+///
+/// The buffer header and its payload live in a single managed block, with the
+/// payload aligned to a cache line.
+/// @param gc The garbage collector to use.
+/// @param size The size of the buffer *(in bytes)* to allocate.
+/// @return A pointer to the allocated managed buffer.
+vgc_Buffer * vgc_create_compact_buffer(vgc_GC *gc, size_t size);
+
+/// @brief Create a compact managed buffer.
+/// @param gc The garbage collector to use.
+/// @param size The size of the buffer *(in bytes)* to allocate.
+/// @param dtor The deconstructor to call (with the buffer) after freeing the managed memory.
+/// @return A pointer to the allocated managed buffer.
+vgc_Buffer * vgc_create_compact_buffer_ext(vgc_GC *gc, size_t size, vgc_Deconstructor dtor);
+
+/// @brief Map the file read-only and shared (the default).
+#define VGC_MMAP_READ 0x0
+/// @brief Map the file writable; writes go through to the file.
+#define VGC_MMAP_WRITE 0x1
+/// @brief Map the file copy-on-write; writes stay private to the process.
+#define VGC_MMAP_PRIVATE 0x2
+/// @brief Prefault the mapping instead of faulting pages in on first access.
+#define VGC_MMAP_POPULATE 0x4
+
+/// @brief Create a managed buffer backed by a memory-mapped file.
+///
+/// The payload is an `mmap()` of the file instead of a copy, and it is
+/// unmapped when the buffer is collected or freed. Only the small buffer
+/// header is managed memory; it is never scanned, so the collector does not
+/// touch the file contents. The descriptor may be closed once the buffer has
+/// been created. Not available on platforms without `mmap()`.
+/// @param gc The garbage collector to use.
+/// @param fd The file descriptor to map.
+/// @param offset The offset into the file; it does not need to be page aligned.
+/// @param length The number of bytes to map, or 0 to map to the end of the file.
+/// @param flags A combination of the `VGC_MMAP_*` flags.
+/// @return A pointer to the managed buffer, or NULL if the file could not be mapped.
+vgc_Buffer * vgc_create_buffer_mmap(vgc_GC *gc, int fd, size_t offset, size_t length, int flags);
+
+/// @brief Create a growable managed vector.
+/// @param gc The garbage collector to use.
+/// @param item_size The size of an item *(in bytes)*.
+/// @param capacity The number of items to reserve storage for.
+/// @return A pointer to the managed vector, or NULL if the allocation failed.
+vgc_Vector * vgc_create_vector(vgc_GC *gc, size_t item_size, size_t capacity);
+
+/// @brief Create a growable managed vector whose items hold no pointers to managed memory.
+/// @details The storage is allocated with `vgc_malloc_noscan()` and never scanned.
+/// @param gc The garbage collector to use.
+/// @param item_size The size of an item *(in bytes)*.
+/// @param capacity The number of items to reserve storage for.
+/// @return A pointer to the managed vector, or NULL if the allocation failed.
+vgc_Vector * vgc_create_vector_noscan(vgc_GC *gc, size_t item_size, size_t capacity);
+
+/// @brief Make room for at least `capacity` items.
+/// @details The storage is grown with `vgc_realloc()`, which extends it in place when the allocator can.
+/// @param gc The garbage collector to use.
+/// @param vector The vector to grow.
+/// @param capacity The number of items to make room for.
+/// @return `true` on success; the vector is unchanged otherwise.
+bool vgc_vector_reserve(vgc_GC *gc, vgc_Vector *vector, size_t capacity);
+
+/// @brief Append an item, doubling the capacity when the vector is full.
+/// @param gc The garbage collector to use.
+/// @param vector The vector to append to.
+/// @param item A pointer to the item to copy into the vector, or NULL to append a zeroed item.
+/// @return A pointer to the appended item, or NULL if the vector could not grow.
+void * vgc_vector_push(vgc_GC *gc, vgc_Vector *vector, const void *item);
+
+/// @brief Remove the last item.
+/// @param vector The vector to remove the item from.
+/// @param item Where to copy the removed item to, or NULL.
+/// @return `false` if the vector was empty.
+bool vgc_vector_pop(vgc_Vector *vector, void *item);
+
+/// @brief Remove all items, keeping the storage.
+/// @param vector The vector to clear.
+void vgc_vector_clear(vgc_Vector *vector);
+
+/// @brief Release the storage that is not used by any item.
+/// @param gc The garbage collector to use.
+/// @param vector The vector to shrink.
+/// @return `true` on success.
+bool vgc_vector_shrink(vgc_GC *gc, vgc_Vector *vector);
+
+/// @brief Access an item of a vector.
+/// @param vector A pointer to the vector.
+/// @param T The type of item.
+/// @param index The index of the item.
+#define vgc_vector_at(vector, T, index)     (((T *) (vector)->buffer.address)[index])
+
+/// @brief Create a slice of a managed buffer without copying it.
+/// @details In a region the slice is bump-allocated, which makes slices cheap to create in bulk.
+/// @param gc The garbage collector to use.
+/// @param buffer The buffer to slice.
+/// @param offset The offset of the slice into the buffer *(in bytes)*.
+/// @param length The length of the slice *(in bytes)*.
+/// @return A pointer to the managed slice, or NULL if the range does not fit into the buffer.
+vgc_Slice * vgc_create_slice(vgc_GC *gc, vgc_Buffer *buffer, size_t offset, size_t length);
+
+/// @brief Create a slice of a managed array without copying it.
+/// @param gc The garbage collector to use.
+/// @param array The array to slice.
+/// @param first The index of the first slot of the slice.
+/// @param count The number of slots in the slice.
+/// @return A pointer to the managed slice, or NULL if the range does not fit into the array.
+vgc_Slice * vgc_create_array_slice(vgc_GC *gc, vgc_Array *array, size_t first, size_t count);
+
+/// @brief Create a slice of a slice, which references the same parent.
+/// @param gc The garbage collector to use.
+/// @param slice The slice to slice.
+/// @param offset The offset of the new slice into `slice` *(in bytes)*.
+/// @param length The length of the new slice *(in bytes)*.
+/// @return A pointer to the managed slice, or NULL if the range does not fit into `slice`.
+vgc_Slice * vgc_create_subslice(vgc_GC *gc, vgc_Slice *slice, size_t offset, size_t length);
+
+/// @brief Split a managed buffer into records.
+/// @details All slices live in one compact array, so splitting costs a single allocation. The last
+///          slice is shorter if the buffer length is not a multiple of `record_size`.
+/// @param gc The garbage collector to use.
+/// @param buffer The buffer to split.
+/// @param record_size The length of each record *(in bytes)*.
+/// @return A compact array of `vgc_Slice`s, or NULL if `record_size` is 0 or the allocation failed.
+vgc_Array * vgc_split_buffer(vgc_GC *gc, vgc_Buffer *buffer, size_t record_size);
+
 /// @brief Create a managed array.
 /// @param tsize The size of an item contained within the array.
 /// @param count The number of items the managed array can hold.
@@ -232,6 +996,12 @@ vgc_Buffer * vgc_create_buffer_ext(vgc_GC *gc, size_t size, vgc_Deconstructor dt
 /// @return A pointer to the allocated managed array.
 #define vgcx_create_array(T, count)     vgc_create_array(VGC_GLOBAL_GC, sizeof(T), count)
 
+/// @brief Create a compact managed array.
+/// @param T The type of an item contained within the array.
+/// @param count The number of items the managed array can hold.
+/// @return A pointer to the allocated managed array.
+#define vgcx_create_compact_array(T, count)     vgc_create_compact_array(VGC_GLOBAL_GC, sizeof(T), count)
+
 /// @brief Destroy a managed array.
 /// @param array The array to destroy.
 void vgc_destroy_array(vgc_Array *array);
@@ -243,7 +1013,7 @@ void vgc_destroy_array(vgc_Array *array);
 /// @param T The type of the new object.
 /// @param dtor The deconstructor to call after freeing the managed memory.
 /// @return A pointer to the allocated managed object.
-#define vgcx_new_ext(gc, T, dtor)       ((T *) vgc_malloc_ext(gc, sizeof(T), dtor))
+#define vgcx_new_ext(gc, T, dtor)       ((T *) vgc_malloc_fast(gc, sizeof(T), dtor))
 
 /// @brief Create a managed object.
 /// @param gc The garbage collector to use.
@@ -1,6 +1,10 @@
 #if !defined(VGC__VGC_HPP)
 #define VGC__VGC_HPP
 
+#include <cstddef>
+#include <new>
+#include <thread>
+#include <type_traits>
 #include <unordered_map>
 
 #include "vgc.h"
@@ -14,9 +18,11 @@
 
 namespace vgc
 {
+    class GarbageCollector;
+
     using ThreadGCMap = std::unordered_map<size_t, vgc::GarbageCollector *>;
 
-    ThreadGCMap __thread_gc_map;
+    extern ThreadGCMap __thread_gc_map;
 
     size_t get_thread_id();
 
@@ -58,15 +64,17 @@ namespace vgc
         size_t stop();
 
         template <typename T, typename... Args>
-        static T * new_(Args... args);
+        static T * new_(Args&&... args);
 
         /// @brief Create a new managed object.
+        /// @details The arguments are perfectly forwarded to the constructor. The object's destructor runs when the
+        ///          object is collected, unless `T` is trivially destructible.
         /// @tparam T The type of object to create.
         /// @tparam ...Args The types of the object's constructor's arguments.
         /// @param ...args A list of arguments to pass to the object's constructor.
         /// @return A pointer to the managed object.
         template <typename T, typename... Args>
-        T * make_managed(Args... args);
+        T * make_managed(Args&&... args);
 
         /// @brief Allocate a block of memory.
         /// @param size The size of the block of managed memory to allocate.
@@ -90,7 +98,8 @@ namespace vgc
         /// @return A pointer to the allocated block of memory.
         void * malloc_ext(size_t size, void (*dtor)(void *));
 
-        /// @brief Allocate a block of memory.
+        /// @brief Allocate a block of memory whose destructor `~T()` runs upon deallocation.
+        /// @details No destructor is registered if `T` is trivially destructible.
         /// @tparam T The type of object to allocate memory for.
         /// @return A pointer to the allocated object.
         template <typename T>
@@ -103,6 +112,11 @@ namespace vgc
         template <typename T>
         T * malloc_ext(void (*dtor)(void *));
 
+        /// @brief Allocate a block of memory that holds no pointers to managed memory and is never scanned.
+        /// @param size The size of the block of managed memory to allocate.
+        /// @return A pointer to the allocated block of memory.
+        void * malloc_noscan(size_t size);
+
         /// @brief Allocate multiple blocks of managed memory at a time.
         /// @param count The number of blocks to allocate.
         /// @param size The size of each block to allocate.
@@ -133,9 +147,321 @@ namespace vgc
         /// @param str1 A pointer to the null-terminated byte string to duplicate.
         /// @return A pointer to the allocated string, or a null pointer if an error occurred.
         char* strdup (const char *str1);
+
+        /// @brief Returns the shared managed copy of a string; equal strings are interned once.
+        /// @param str1 A pointer to the null-terminated byte string to intern.
+        /// @return A pointer to the interned string, or a null pointer if an error occurred.
+        const char * intern(const char *str1);
+
+        /// @brief Begin a region. Until the matching `region_end()`, allocations are released in bulk.
+        void region_begin();
+
+        /// @brief End the innermost region, releasing every object in it that was not promoted.
+        /// @return The number of bytes released.
+        size_t region_end();
+
+        /// @brief Promote an object *(and every region object reachable from it)* out of its region.
+        /// @tparam T The type of the object.
+        /// @param ptr A pointer to the object.
+        /// @return `ptr`.
+        template <typename T>
+        T * promote(T *ptr);
+
+        /// @brief Recycle the memory of collected objects of type `T` for new objects of the same size.
+        /// @details `make_managed<T>()` takes memory from the pool before asking the system for more.
+        /// @tparam T The type of object to pool.
+        /// @param max_bytes The maximum number of bytes the pool may hold on to.
+        /// @return `true` on success.
+        template <typename T>
+        bool add_pool(size_t max_bytes);
+
+        /// @brief Enable or disable conservative scanning of the stack and registers.
+        /// @param enabled Whether the stack should be scanned.
+        void set_stack_scanning(bool enabled);
     private:
+        template <typename T>
+        friend class gc_ptr;
+
+        template <typename T>
+        friend class span_ref;
+
+        template <typename T>
+        friend class vector;
+
+        /// @brief The deconstructor thunk of managed objects of type `T`.
+        template <typename T>
+        static void destroy(void *memory);
+
         vgc_GC _instance;
     };
+
+    /// @brief A precise reference to a managed object.
+    /// @details Every `gc_ptr` registers a shadow root with its collector, so the object it points to survives
+    ///          collections even with stack scanning disabled. Fields inside managed objects should stay raw pointers;
+    ///          they are found by scanning the object that holds them. A `gc_ptr` must not outlive its collector.
+    /// @tparam T The type of the referenced object.
+    template <typename T>
+    class gc_ptr
+    {
+    public:
+        /// @brief Create a handle.
+        /// @param gc The garbage collector that owns the object.
+        /// @param ptr A pointer to the object *(or `nullptr`)*.
+        explicit gc_ptr(GarbageCollector &gc, T *ptr = nullptr);
+
+        gc_ptr(const gc_ptr &other);
+
+        gc_ptr(gc_ptr &&other) noexcept;
+
+        gc_ptr & operator=(const gc_ptr &other);
+
+        gc_ptr & operator=(T *ptr);
+
+        /// @brief Unregister the handle's root.
+        ~gc_ptr();
+
+        T * get() const;
+
+        T & operator*() const;
+
+        T * operator->() const;
+
+        explicit operator bool() const;
+
+        /// @brief Point the handle at another object *(or at nothing)*.
+        /// @param ptr A pointer to the object.
+        void reset(T *ptr = nullptr);
+    private:
+        GarbageCollector *_gc;
+        vgc_ShadowRoot _root;
+    };
+
+    /// @brief A `gc_ptr` for local variables, which can be neither copied nor moved.
+    /// @tparam T The type of the referenced object.
+    template <typename T>
+    class gc_root : public gc_ptr<T>
+    {
+    public:
+        using gc_ptr<T>::gc_ptr;
+        using gc_ptr<T>::operator=;
+
+        gc_root(const gc_root &) = delete;
+
+        gc_root & operator=(const gc_root &) = delete;
+    };
+
+    /// @brief Whether objects of type `T` can never hold pointers to managed memory.
+    /// @details Specialize this for your own pointer-free types to keep them out of the mark phase.
+    /// @tparam T The type of object.
+    template <typename T>
+    struct is_pointer_free : std::integral_constant<bool, std::is_arithmetic<T>::value || std::is_enum<T>::value>
+    {
+    };
+
+    /// @brief A standard allocator that places container storage on the managed heap.
+    /// @details Storage for pointer-free element types is never scanned; everything else is scanned conservatively.
+    ///          The container object itself must be reachable by the collector *(on the stack, in managed memory or in
+    ///          a root range)*, otherwise its storage is collected from under it.
+    /// @tparam T The type of element.
+    template <typename T>
+    class allocator
+    {
+    public:
+        using value_type = T;
+        using size_type = std::size_t;
+        using difference_type = std::ptrdiff_t;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+        using is_always_equal = std::false_type;
+
+        /// @brief Whether the storage is scanned for references.
+        static constexpr bool scanned = !is_pointer_free<T>::value;
+
+        template <typename U>
+        struct rebind
+        {
+            using other = allocator<U>;
+        };
+
+        /// @brief Create an allocator.
+        /// @param gc The garbage collector that manages the storage.
+        allocator(GarbageCollector &gc) noexcept;
+
+        template <typename U>
+        allocator(const allocator<U> &other) noexcept;
+
+        /// @brief Allocate storage for `n` elements.
+        /// @param n The number of elements.
+        /// @return A pointer to the storage.
+        T * allocate(size_type n);
+
+        /// @brief Release storage right away instead of waiting for a collection.
+        /// @param ptr A pointer to the storage.
+        /// @param n The number of elements.
+        void deallocate(T *ptr, size_type n) noexcept;
+
+        /// @brief The garbage collector that manages the storage.
+        GarbageCollector * collector() const noexcept;
+    private:
+        GarbageCollector *_gc;
+    };
+
+    template <typename T, typename U>
+    bool operator==(const allocator<T> &a, const allocator<U> &b) noexcept;
+
+    template <typename T, typename U>
+    bool operator!=(const allocator<T> &a, const allocator<U> &b) noexcept;
+
+    /// @brief A typed, zero-copy view of part of a managed buffer or array.
+    /// @details The view refers to a managed `vgc_Slice`, which keeps the parent buffer or array alive. Like a raw
+    ///          pointer, the `span_ref` itself must be reachable by the collector *(on the stack or in managed
+    ///          memory)*; copying it copies the reference, not the slice.
+    /// @tparam T The type of element.
+    template <typename T>
+    class span_ref
+    {
+    public:
+        using element_type = T;
+        using size_type = std::size_t;
+        using iterator = T *;
+
+        /// @brief Create an empty view.
+        span_ref() noexcept;
+
+        /// @brief Wrap an existing slice.
+        /// @param slice A pointer to the slice *(or `nullptr`)*.
+        explicit span_ref(vgc_Slice *slice) noexcept;
+
+        /// @brief View `count` elements of a buffer, starting at element `first`.
+        /// @param gc The garbage collector that manages the buffer.
+        /// @param buffer The buffer to view.
+        /// @param first The index of the first element.
+        /// @param count The number of elements.
+        span_ref(GarbageCollector &gc, vgc_Buffer *buffer, size_type first, size_type count);
+
+        /// @brief View `count` slots of an array, starting at slot `first`.
+        /// @param gc The garbage collector that manages the array.
+        /// @param array The array to view *(its slot size should be `sizeof(T)`)*.
+        /// @param first The index of the first slot.
+        /// @param count The number of slots.
+        span_ref(GarbageCollector &gc, vgc_Array *array, size_type first, size_type count);
+
+        /// @brief View part of this view.
+        /// @param gc The garbage collector that manages the parent.
+        /// @param first The index of the first element.
+        /// @param count The number of elements.
+        /// @return A view of the same parent.
+        span_ref subspan(GarbageCollector &gc, size_type first, size_type count) const;
+
+        T * data() const noexcept;
+
+        size_type size() const noexcept;
+
+        bool empty() const noexcept;
+
+        T & operator[](size_type index) const;
+
+        iterator begin() const noexcept;
+
+        iterator end() const noexcept;
+
+        /// @brief The underlying managed slice.
+        vgc_Slice * slice() const noexcept;
+    private:
+        vgc_Slice *_slice;
+    };
+
+    /// @brief A growable array on the managed heap.
+    /// @details The items live in a managed `vgc_Vector`, whose storage grows geometrically and is extended in place
+    ///          when the allocator allows it. Storage for pointer-free element types is never scanned. Items are
+    ///          moved bitwise when the storage grows, so `T` must be trivially copyable. Like a raw pointer, the
+    ///          `vector` itself must be reachable by the collector; copying it copies the reference, not the items.
+    /// @tparam T The type of element.
+    template <typename T>
+    class vector
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "vgc::vector requires trivially copyable elements");
+    public:
+        using value_type = T;
+        using size_type = std::size_t;
+        using iterator = T *;
+
+        /// @brief Create an empty vector.
+        /// @param gc The garbage collector that manages the vector.
+        /// @param capacity The number of elements to reserve storage for.
+        explicit vector(GarbageCollector &gc, size_type capacity = 0);
+
+        /// @brief Append an element.
+        /// @param value The element to append.
+        void push_back(const T &value);
+
+        /// @brief Remove the last element.
+        void pop_back();
+
+        /// @brief Make room for at least `capacity` elements.
+        /// @param capacity The number of elements.
+        void reserve(size_type capacity);
+
+        /// @brief Release the storage that is not used by any element.
+        void shrink_to_fit();
+
+        /// @brief Remove all elements, keeping the storage.
+        void clear() noexcept;
+
+        T * data() const noexcept;
+
+        size_type size() const noexcept;
+
+        size_type capacity() const noexcept;
+
+        bool empty() const noexcept;
+
+        T & operator[](size_type index) const;
+
+        T & back() const;
+
+        iterator begin() const noexcept;
+
+        iterator end() const noexcept;
+
+        /// @brief View part of the vector. The view stays valid while the storage does not move.
+        /// @param first The index of the first element.
+        /// @param count The number of elements.
+        /// @return A view of the vector's array.
+        span_ref<T> subspan(size_type first, size_type count) const;
+
+        /// @brief The underlying managed vector.
+        vgc_Vector * get() const noexcept;
+    private:
+        GarbageCollector *_gc;
+        vgc_Vector *_vector;
+    };
+
+    /// @brief A guard that keeps a region active for as long as it is in scope.
+    class Region
+    {
+    public:
+        /// @brief Begin a region.
+        /// @param gc The garbage collector whose allocations the region captures.
+        explicit Region(GarbageCollector &gc);
+
+        Region(const Region &) = delete;
+
+        Region & operator=(const Region &) = delete;
+
+        /// @brief End the region, releasing every object in it that was not promoted.
+        ~Region();
+
+        /// @brief Promote an object so that it survives the region.
+        /// @tparam T The type of the object.
+        /// @param ptr A pointer to the object.
+        /// @return `ptr`.
+        template <typename T>
+        T * promote(T *ptr);
+    private:
+        GarbageCollector &_gc;
+    };
 }
 
 
@@ -0,0 +1,67 @@
+#include <stdio.h>
+#include <time.h>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+#include "../src/vgc.h"
+
+#include "../src/vgc.c"
+
+/*
+ * Allocates small objects inside a region, once through vgc_malloc_ext()
+ * and once through the inline vgc_malloc_fast(), which only leaves
+ * the caller when the region's current span is exhausted. Every round reuses the
+ * spans the previous one released, so page faults stay out of the
+ * measurement.
+ */
+
+#define OBJECTS     (1 << 18)
+#define ROUNDS      64
+#define OBJECT_SIZE 16
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double run(vgc_GC *gc, bool fast)
+{
+    double best = 0;
+    for (int round = 0; round < ROUNDS; ++round) {
+        vgc_region_begin(gc);
+        double start = now_ms();
+        for (size_t i = 0; i < OBJECTS; ++i) {
+            long *obj = (long *) (fast ? vgc_malloc_fast(gc, OBJECT_SIZE, NULL)
+                                       : vgc_malloc_ext(gc, OBJECT_SIZE, NULL));
+            obj[0] = (long) i;
+        }
+        double elapsed = now_ms() - start;
+        vgc_region_end(gc);
+        if (round == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best;
+}
+
+int main(void)
+{
+#if defined(__GLIBC__)
+    /* Keep released spans mapped instead of trimming the heap after every round */
+    mallopt(M_TRIM_THRESHOLD, 1 << 30);
+#endif
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+
+    double ext = run(&gc, false);
+    double fast = run(&gc, true);
+    printf("malloc_ext: %.2f ms, malloc_fast: %.2f ms (%d objects of %d bytes, %.2fx)\n",
+           ext, fast, OBJECTS, OBJECT_SIZE, ext / fast);
+
+    vgc_stop(&gc);
+    return 0;
+}
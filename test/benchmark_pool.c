@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/vgc.h"
+
+/* Built with `-DLINK_LIBVGC`, the benchmark runs against a prebuilt libvgc */
+#if !defined(LINK_LIBVGC)
+#include "../src/vgc.c"
+#endif
+
+/*
+ * Allocates short-lived objects of one size in a loop, collecting every
+ * `BATCH` allocations, once with the system allocator and once with a
+ * recycling pool for that size.
+ */
+
+#define OBJECTS     (1 << 22)
+#define BATCH       (1 << 14)
+#define OBJECT_SIZE 32
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static double run(bool pooled)
+{
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_disable(&gc);
+    vgc_set_stack_scanning(&gc, false);
+    if (pooled) {
+        vgc_add_pool(&gc, OBJECT_SIZE, BATCH * OBJECT_SIZE);
+    }
+
+    double start = now_ms();
+    for (size_t i = 0; i < OBJECTS; ++i) {
+        long *obj = (long *) vgc_malloc(&gc, OBJECT_SIZE);
+        obj[0] = (long) i;
+        if (i % BATCH == BATCH - 1) {
+            vgc_collect(&gc);
+        }
+    }
+    double elapsed = now_ms() - start;
+
+    vgc_stop(&gc);
+    return elapsed;
+}
+
+int main(void)
+{
+    double system = run(false);
+    double pooled = run(true);
+    printf("malloc: %.2f ms, pool: %.2f ms (%d objects of %d bytes, %.2fx)\n",
+           system, pooled, OBJECTS, OBJECT_SIZE, system / pooled);
+    return 0;
+}
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/vgc.h"
+
+#include "../src/vgc.c"
+
+/*
+ * Inserts millions of entries into the allocation map and reports the
+ * slowest single insert, which is where a resize would stall. Build with
+ * `-DVGC_REHASH_STEP=SIZE_MAX` to migrate all buckets at once instead.
+ */
+
+#define ENTRIES (1 << 23)
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+int main(void)
+{
+    vgc_AllocationMap *am = vgc_allocation_map_new(1024, 1024, 0.5, 0.2, 0.8);
+    /* Keys only need to be distinct, they are never dereferenced */
+    char *base = (char *) 0x100000;
+
+    double worst = 0;
+    double start = now_us();
+    for (size_t i = 0; i < ENTRIES; ++i) {
+        double t = now_us();
+        vgc_allocation_map_put(am, base + 16 * i, 16, NULL);
+        t = now_us() - t;
+        if (t > worst) {
+            worst = t;
+        }
+    }
+    double total = now_us() - start;
+
+    printf("insert: %.2f ms total, slowest %.1f us (%d entries, rehash step %zu)\n",
+           total / 1e3, worst, ENTRIES, (size_t) VGC_REHASH_STEP);
+    vgc_allocation_map_delete(am);
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/vgc.h"
+
+#include "../src/vgc.c"
+
+/*
+ * Measures vgc_malloc()/vgc_free() throughput of the striped allocation map
+ * with 1 to 16 threads sharing one collector. Every thread allocates a batch
+ * of objects and frees them again. Build with `-DVGC_MAP_STRIPES=1` to
+ * compare against a single map lock.
+ */
+
+#define OPS_PER_THREAD  (1 << 20)
+#define BATCH           64
+#define MAX_THREADS     16
+
+static vgc_GC gc;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void *worker(void *arg)
+{
+    (void) arg;
+    void *batch[BATCH];
+    for (size_t i = 0; i < OPS_PER_THREAD / BATCH; ++i) {
+        for (size_t j = 0; j < BATCH; ++j) {
+            batch[j] = vgc_malloc(&gc, 16 + j);
+        }
+        for (size_t j = 0; j < BATCH; ++j) {
+            vgc_free(&gc, batch[j]);
+        }
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+
+    double base = 0;
+    for (int n = 1; n <= MAX_THREADS; n *= 2) {
+        pthread_t threads[MAX_THREADS];
+        double start = now_ms();
+        for (int t = 0; t < n; ++t) {
+            pthread_create(&threads[t], NULL, worker, NULL);
+        }
+        for (int t = 0; t < n; ++t) {
+            pthread_join(threads[t], NULL);
+        }
+        double elapsed = now_ms() - start;
+        /* One malloc and one free per op */
+        double mops = 2.0 * n * OPS_PER_THREAD / elapsed / 1e3;
+        if (n == 1) {
+            base = mops;
+        }
+        printf("%2d threads: %7.2f Mops/s (%.2fx, %d stripes)\n", n, mops, mops / base, VGC_MAP_STRIPES);
+    }
+
+    vgc_stop(&gc);
+    return 0;
+}
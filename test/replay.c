@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/vgc.h"
+
+/* Built with `-DLINK_LIBVGC`, the trace is replayed against a prebuilt libvgc */
+#if !defined(LINK_LIBVGC)
+#include "../src/vgc.c"
+#endif
+
+/*
+ * Replays an allocation trace recorded with vgc_record_start() and reports
+ * how long the allocations and collections took. Rebuild with different
+ * configuration macros (or against a different libvgc) to compare them on
+ * the same workload.
+ *
+ * Live objects are kept in a table that is registered as a root range. An
+ * object is dropped from the table when the recorded program freed it or
+ * the recorded collection swept it, so the replayed collections find the
+ * same garbage. The recorded contents of changed objects are rebuilt before
+ * every collection, which gives marking the same graph to traverse.
+ *
+ * Usage: replay [-a] <trace>
+ *   -a  let allocations trigger collections as configured, instead of
+ *       replaying the recorded automatic collections
+ */
+
+static vgc_GC gc;
+static void **objects;
+static size_t capacity;
+static size_t dtor_count;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void dtor(void *ptr)
+{
+    (void) ptr;
+    dtor_count++;
+}
+
+static void reserve(uint32_t id)
+{
+    if (id < capacity) {
+        return;
+    }
+    size_t new_capacity = capacity ? capacity : 1024;
+    while (new_capacity <= id) {
+        new_capacity *= 2;
+    }
+    if (objects) {
+        vgc_remove_root_range(&gc, objects, objects + capacity);
+    }
+    objects = (void **) realloc(objects, new_capacity * sizeof(void *));
+    if (!objects) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    memset(objects + capacity, 0, (new_capacity - capacity) * sizeof(void *));
+    capacity = new_capacity;
+    vgc_add_root_range(&gc, objects, objects + capacity);
+}
+
+/* The trace is streamed, with one event of lookahead */
+static FILE *trace;
+static vgc_RecordEvent pending;
+static bool has_pending;
+
+static bool next(vgc_RecordEvent *e)
+{
+    if (has_pending) {
+        has_pending = false;
+        *e = pending;
+        return true;
+    }
+    return fread(e, sizeof(vgc_RecordEvent), 1, trace) == 1;
+}
+
+static void push_back(const vgc_RecordEvent *e)
+{
+    pending = *e;
+    has_pending = true;
+}
+
+static void *object(uint32_t id)
+{
+    return id < capacity ? objects[id] : NULL;
+}
+
+int main(int argc, char **argv)
+{
+    bool automatic = argc == 3 && strcmp(argv[1], "-a") == 0;
+    if (argc != 2 && !automatic) {
+        fprintf(stderr, "usage: %s [-a] <trace>\n", argv[0]);
+        return 2;
+    }
+    trace = fopen(argv[argc - 1], "rb");
+    if (!trace) {
+        perror(argv[argc - 1]);
+        return 1;
+    }
+    char magic[sizeof(VGC_RECORD_MAGIC)];
+    if (fread(magic, sizeof(magic), 1, trace) != 1 || memcmp(magic, VGC_RECORD_MAGIC, sizeof(magic)) != 0) {
+        fprintf(stderr, "%s: not an allocation trace\n", argv[argc - 1]);
+        fclose(trace);
+        return 1;
+    }
+
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    if (!automatic) {
+        vgc_disable(&gc);
+    }
+
+    size_t count = 0;
+    size_t collections = 0;
+    size_t freed = 0;
+    double collect_ms = 0;
+    double start = now_ms();
+    vgc_RecordEvent e;
+    while (next(&e)) {
+        count++;
+        vgc_Deconstructor d = (e.flags & VGC_RECORD_DTOR) ? dtor : NULL;
+        switch (e.type) {
+        case VGC_RECORD_MALLOC:
+            reserve(e.id);
+            objects[e.id] = vgc_malloc_ext(&gc, e.size, d);
+            break;
+        case VGC_RECORD_CALLOC:
+            reserve(e.id);
+            objects[e.id] = vgc_calloc_ext(&gc, 1, e.size, d);
+            break;
+        case VGC_RECORD_REALLOC: {
+            void *p = object(e.arg);
+            if (p) {
+                objects[e.arg] = NULL;
+            }
+            reserve(e.id);
+            objects[e.id] = vgc_realloc(&gc, p, e.size);
+            break;
+        }
+        case VGC_RECORD_FREE:
+            if (object(e.id)) {
+                vgc_free(&gc, objects[e.id]);
+                objects[e.id] = NULL;
+            }
+            break;
+        case VGC_RECORD_SWEEP:
+            /* Dropped here, collected by the next replayed collection */
+            if (object(e.id)) {
+                objects[e.id] = NULL;
+            }
+            break;
+        case VGC_RECORD_COLLECT: {
+            /* Rebuild the changed part of the graph and drop this collection's garbage first */
+            vgc_RecordEvent f;
+            while (next(&f)) {
+                if (f.type == VGC_RECORD_CONTENTS && object(f.id)) {
+                    memset(objects[f.id], 0, f.size);
+                } else if (f.type == VGC_RECORD_EDGE && object(f.id)) {
+                    *(void **) ((char *) objects[f.id] + f.size) = object(f.arg);
+                } else if (f.type == VGC_RECORD_SWEEP && object(f.id)) {
+                    objects[f.id] = NULL;
+                } else if (f.type != VGC_RECORD_CONTENTS && f.type != VGC_RECORD_EDGE && f.type != VGC_RECORD_SWEEP) {
+                    push_back(&f);
+                    break;
+                }
+                count++;
+            }
+            if (!automatic || !(e.flags & VGC_RECORD_AUTO)) {
+                double t = now_ms();
+                freed += vgc_collect(&gc);
+                collect_ms += now_ms() - t;
+                collections++;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    double total_ms = now_ms() - start;
+
+    printf("replayed %zu events in %.2f ms (%.2f ms in %zu collections, %zu bytes freed, %zu destructors)\n",
+           count, total_ms, collect_ms, collections, freed, dtor_count);
+    vgc_stop(&gc);
+    free(objects);
+    fclose(trace);
+    return 0;
+}
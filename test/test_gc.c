@@ -26,6 +26,26 @@ static char* test_primes()
     return 0;
 }
 
+/* Count the tracked allocations, including those still pending in the allocation span */
+static size_t _allocation_count(vgc_GC* gc)
+{
+    vgc_span_flush(gc);
+    return vgc_allocation_map_size(gc->allocs);
+}
+
+static void _scrub_stack()
+{
+    /* Wipe stale pointers left behind by deeper calls */
+    volatile char junk[16384];
+    memset((char*) junk, 0, sizeof(junk));
+}
+
+/* Clear the mark bit of an allocation, so a test can mark again */
+static void unmark(vgc_GC* gc, vgc_Allocation* a)
+{
+    gc->allocs->marks[VGC_SLOT_WORD(a->slot)] &= ~VGC_SLOT_MASK(a->slot);
+}
+
 void dtor(void* ptr)
 {
     UNUSED(ptr);
@@ -35,14 +55,18 @@ void dtor(void* ptr)
 static char* test_gc_allocation_new_delete()
 {
     int* ptr = malloc(sizeof(int));
-    vgc_Allocation* a = vgc_allocation_new(ptr, sizeof(int), dtor);
+    vgc_AllocationMap* am = vgc_allocation_map_new(8, 16, 0.5, 0.2, 0.8);
+    vgc_Allocation* a = vgc_allocation_new(am, ptr, sizeof(int), dtor);
     mu_assert(a != NULL, "vgc_Allocation should return non-NULL");
     mu_assert(a->ptr == ptr, "vgc_Allocation should contain original pointer");
     mu_assert(a->size == sizeof(int), "Size of mem pointed to should not change");
     mu_assert(a->tag == VGC_TAG_NONE, "Annotation should initially be untagged");
+    mu_assert(!vgc_allocation_is_marked(am, a), "Annotation should initially be unmarked");
     mu_assert(a->dtor == dtor, "Destructor pointer should not change");
     mu_assert(a->next == NULL, "Annotation should initilally be unlinked");
-    vgc_allocation_delete(a);
+    vgc_allocation_delete(am, a);
+    mu_assert(*vgc_allocation_map_free_list(am, ptr) == a, "Deleted annotations should be recycled");
+    vgc_allocation_map_delete(am);
     free(ptr);
     return NULL;
 }
@@ -54,7 +78,7 @@ static char* test_gc_allocation_map_new_delete()
     vgc_AllocationMap* am = vgc_allocation_map_new(8, 16, 0.5, 0.2, 0.8);
     mu_assert(am->min_capacity == 11, "True min capacity should be next prime");
     mu_assert(am->capacity == 17, "True capacity should be next prime");
-    mu_assert(am->size == 0, "vgc_Allocation map should be initialized to empty");
+    mu_assert(vgc_allocation_map_size(am) == 0, "vgc_Allocation map should be initialized to empty");
     mu_assert(am->sweep_limit == 8, "Incorrect sweep limit calculation");
     mu_assert(am->downsize_factor == 0.2, "Downsize factor should not change");
     mu_assert(am->upsize_factor == 0.8, "Upsize factor should not change");
@@ -65,7 +89,7 @@ static char* test_gc_allocation_map_new_delete()
     am = vgc_allocation_map_new(8, 4, 0.5, 0.2, 0.8);
     mu_assert(am->min_capacity == 11, "True min capacity should be next prime");
     mu_assert(am->capacity == 11, "True capacity should be next prime");
-    mu_assert(am->size == 0, "vgc_Allocation map should be initialized to empty");
+    mu_assert(vgc_allocation_map_size(am) == 0, "vgc_Allocation map should be initialized to empty");
     mu_assert(am->sweep_limit == 5, "Incorrect sweep limit calculation");
     mu_assert(am->downsize_factor == 0.2, "Downsize factor should not change");
     mu_assert(am->upsize_factor == 0.8, "Upsize factor should not change");
@@ -89,7 +113,7 @@ static char* test_gc_allocation_map_basic_get()
     *five = 5;
     a = vgc_allocation_map_put(am, five, sizeof(int), NULL);
     mu_assert(a != NULL, "Result of PUT on allocation map must be non-NULL");
-    mu_assert(am->size == 1, "Expect size of one-element map to be one");
+    mu_assert(vgc_allocation_map_size(am) == 1, "Expect size of one-element map to be one");
     mu_assert(am->allocs != NULL, "vgc_AllocationMap must hold list of allocations");
     vgc_Allocation* b = vgc_allocation_map_get(am, five);
     mu_assert(a == b, "Get should return the same result as put");
@@ -98,14 +122,14 @@ static char* test_gc_allocation_map_basic_get()
 
     /* Update the entry  and query */
     a = vgc_allocation_map_put(am, five, sizeof(int), dtor);
-    mu_assert(am->size == 1, "Expect size of one-element map to be one");
+    mu_assert(vgc_allocation_map_size(am) == 1, "Expect size of one-element map to be one");
     mu_assert(a->dtor == dtor, "Setting the dtor should set the dtor");
     b = vgc_allocation_map_get(am, five);
     mu_assert(b->dtor == dtor, "Failed to persist the dtor update");
 
     /* Delete the entry */
     vgc_allocation_map_remove(am, five, true);
-    mu_assert(am->size == 0, "After removing last item, map should be empty");
+    mu_assert(vgc_allocation_map_size(am) == 0, "After removing last item, map should be empty");
     vgc_Allocation* c = vgc_allocation_map_get(am, five);
     mu_assert(c == NULL, "Empty allocation map must not contain any allocations");
 
@@ -132,17 +156,17 @@ static char* test_gc_allocation_map_put_get_remove()
     for (size_t i=0; i<64; ++i) {
         a = vgc_allocation_map_put(am, ints[i], sizeof(int), NULL);
     }
-    mu_assert(am->size == 64, "Maps w/ 64 elements should have size 64");
+    mu_assert(vgc_allocation_map_size(am) == 64, "Maps w/ 64 elements should have size 64");
     /* Now update all of them with a new dtor */
     for (size_t i=0; i<64; ++i) {
         a = vgc_allocation_map_put(am, ints[i], sizeof(int), dtor);
     }
-    mu_assert(am->size == 64, "Maps w/ 64 elements should have size 64");
+    mu_assert(vgc_allocation_map_size(am) == 64, "Maps w/ 64 elements should have size 64");
     /* Now delete all of them again */
     for (size_t i=0; i<64; ++i) {
         vgc_allocation_map_remove(am, ints[i], true);
     }
-    mu_assert(am->size == 0, "Empty map must have size 0");
+    mu_assert(vgc_allocation_map_size(am) == 0, "Empty map must have size 0");
     /* And delete the entire map */
     vgc_allocation_map_delete(am);
 
@@ -155,6 +179,50 @@ static char* test_gc_allocation_map_put_get_remove()
     return NULL;
 }
 
+static char* test_gc_allocation_map_incremental_resize()
+{
+    size_t n = 4096;
+    int** ints = malloc(n*sizeof(int*));
+    for (size_t i=0; i<n; ++i) {
+        ints[i] = malloc(sizeof(int));
+    }
+
+    vgc_AllocationMap* am = vgc_allocation_map_new(8, 16, 0.5, 0.2, 0.8);
+    size_t resizes = 0;
+    for (size_t i=0; i<n; ++i) {
+        bool migrating = am->old_allocs != NULL;
+        vgc_allocation_map_put(am, ints[i], sizeof(int), NULL);
+        if (!migrating && am->old_allocs) {
+            resizes++;
+            /* The insert that starts a resize does not migrate anything */
+            mu_assert(am->migrate_index == 0, "Starting a resize should not migrate anything");
+        }
+        /* Lookups consult both bucket arrays */
+        mu_assert(vgc_allocation_map_get(am, ints[i / 2]) != NULL, "Entries should stay visible while migrating");
+    }
+#if !defined(VGC_THREADS)
+    mu_assert(resizes > 1, "The map should have grown incrementally");
+#endif
+    for (size_t i=0; i<n; ++i) {
+        mu_assert(vgc_allocation_map_get(am, ints[i])->ptr == ints[i], "Lost an entry while resizing");
+    }
+    /* Shrinking migrates incrementally as well */
+    for (size_t i=0; i<n; ++i) {
+        vgc_allocation_map_remove(am, ints[i], true);
+        if (i + 1 < n) {
+            mu_assert(vgc_allocation_map_get(am, ints[n - 1]) != NULL, "Lost an entry while shrinking");
+        }
+    }
+    mu_assert(vgc_allocation_map_size(am) == 0, "Empty map must have size 0");
+    vgc_allocation_map_delete(am);
+
+    for (size_t i=0; i<n; ++i) {
+        free(ints[i]);
+    }
+    free(ints);
+    return NULL;
+}
+
 static char* test_gc_allocation_map_cleanup()
 {
     /* Make sure that the entries in the allocation map get reset
@@ -201,10 +269,10 @@ static char* test_gc_mark_stack()
     int** five_ptr = vgc_calloc(&gc, 2, sizeof(int*));
     vgc_mark_stack(&gc);
     vgc_Allocation* a = vgc_allocation_map_get(gc.allocs, five_ptr);
-    mu_assert(a->tag & VGC_TAG_MARK, "Heap allocation referenced from stack should be tagged");
+    mu_assert(vgc_allocation_is_marked(gc.allocs, a), "Heap allocation referenced from stack should be tagged");
 
     /* manually reset the tags */
-    a->tag = VGC_TAG_NONE;
+    unmark(&gc, a);
 
     /* Part 2: Add dependent allocations and check if these allocations
      * get marked properly*/
@@ -214,18 +282,18 @@ static char* test_gc_mark_stack()
     *five_ptr[1] = 5;
     vgc_mark_stack(&gc);
     a = vgc_allocation_map_get(gc.allocs, five_ptr);
-    mu_assert(a->tag & VGC_TAG_MARK, "Referenced heap allocation should be tagged");
+    mu_assert(vgc_allocation_is_marked(gc.allocs, a), "Referenced heap allocation should be tagged");
     for (size_t i=0; i<2; ++i) {
         a = vgc_allocation_map_get(gc.allocs, five_ptr[i]);
-        mu_assert(a->tag & VGC_TAG_MARK, "Dependent heap allocs should be tagged");
+        mu_assert(vgc_allocation_is_marked(gc.allocs, a), "Dependent heap allocs should be tagged");
     }
 
     /* Clean up the tags manually */
     a = vgc_allocation_map_get(gc.allocs, five_ptr);
-    a->tag = VGC_TAG_NONE;
+    unmark(&gc, a);
     for (size_t i=0; i<2; ++i) {
         a = vgc_allocation_map_get(gc.allocs, five_ptr[i]);
-        a->tag = VGC_TAG_NONE;
+        unmark(&gc, a);
     }
 
     /* Part3: Now delete the pointer to five_ptr[1] which should
@@ -234,22 +302,109 @@ static char* test_gc_mark_stack()
     five_ptr[1] = NULL;
     vgc_mark_stack(&gc);
     a = vgc_allocation_map_get(gc.allocs, five_ptr);
-    mu_assert(a->tag & VGC_TAG_MARK, "Referenced heap allocation should be tagged");
+    mu_assert(vgc_allocation_is_marked(gc.allocs, a), "Referenced heap allocation should be tagged");
     a = vgc_allocation_map_get(gc.allocs, five_ptr[0]);
-    mu_assert(a->tag & VGC_TAG_MARK, "Referenced alloc should be tagged");
-    mu_assert(unmarked_alloc->tag == VGC_TAG_NONE, "Unreferenced alloc should not be tagged");
+    mu_assert(vgc_allocation_is_marked(gc.allocs, a), "Referenced alloc should be tagged");
+    mu_assert(!vgc_allocation_is_marked(gc.allocs, unmarked_alloc), "Unreferenced alloc should not be tagged");
 
     /* Clean up the tags manually, again */
     a = vgc_allocation_map_get(gc.allocs, five_ptr[0]);
-    a->tag = VGC_TAG_NONE;
+    unmark(&gc, a);
     a = vgc_allocation_map_get(gc.allocs, five_ptr);
-    a->tag = VGC_TAG_NONE;
+    unmark(&gc, a);
 
     vgc_stop(&gc);
     return NULL;
 }
 
 
+static char* _check_scan_kernel(vgc_GC* gc, vgc_ScanKernel kernel)
+{
+    /* Mix managed pointers with in-range non-pointers and out-of-range junk */
+    void* objs[16];
+    void* words[37];
+    for (size_t i=0; i<16; ++i) {
+        objs[i] = vgc_malloc(gc, 16);
+    }
+    for (size_t i=0; i<37; ++i) {
+        words[i] = (i % 3 == 0) ? objs[i % 16] : (void*) (uintptr_t) (i * 977);
+    }
+    words[35] = (char*) objs[0] + 1;
+    /* Kernels only see allocations that are in the allocation map */
+    vgc_span_flush(gc);
+    kernel(gc, words, words + 37, gc->allocs->min_ptr, gc->allocs->max_ptr);
+    vgc_mark_drain(gc);
+    for (size_t i=0; i<16; ++i) {
+        vgc_Allocation* a = vgc_allocation_map_get(gc->allocs, objs[i]);
+        bool referenced = false;
+        for (size_t j=0; j<37; j+=3) {
+            referenced |= (j % 16) == i;
+        }
+        mu_assert(vgc_allocation_is_marked(gc->allocs, a) == referenced,
+                  "Scan kernel should mark exactly the referenced allocations");
+        vgc_free(gc, objs[i]);
+    }
+    return NULL;
+}
+
+static char* test_gc_scan_kernels()
+{
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_disable(&gc);
+
+    char* error = _check_scan_kernel(&gc, vgc_scan_scalar);
+    mu_assert(error == NULL, error);
+    error = _check_scan_kernel(&gc, vgc_scan_kernel_select());
+    mu_assert(error == NULL, error);
+#if defined(VGC_SCAN_X86) && UINTPTR_MAX == UINT64_MAX
+    if (__builtin_cpu_supports("sse4.2")) {
+        error = _check_scan_kernel(&gc, vgc_scan_sse42);
+        mu_assert(error == NULL, error);
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        error = _check_scan_kernel(&gc, vgc_scan_avx2);
+        mu_assert(error == NULL, error);
+    }
+#endif
+
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_mark_queue()
+{
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_disable(&gc);
+
+    /* A list this long would overflow the stack if marking recursed */
+    const size_t n = 200000;
+    void** head = NULL;
+    for (size_t i=0; i<n; ++i) {
+        void** node = (void**) vgc_malloc(&gc, 2 * sizeof(void*));
+        node[0] = head;
+        node[1] = NULL;
+        head = node;
+    }
+    vgc_mark_alloc(&gc, head);
+    mu_assert(gc.mark_queue->count == 0 && gc.mark_queue->gray_size == 0,
+              "Mark queue should be empty once marking returns");
+    size_t marked = 0;
+    for (void** node = head; node; node = (void**) node[0]) {
+        marked += vgc_allocation_is_marked(gc.allocs, vgc_allocation_map_get(gc.allocs, node));
+    }
+    mu_assert(marked == n, "Every node of the list should be marked");
+
+    /* Sweeping clears the marks so that stopping releases the list */
+    vgc_sweep(&gc);
+    head = NULL;
+    vgc_stop(&gc);
+    return NULL;
+}
+
 static char* test_gc_basic_alloc_free()
 {
     /* Create an array of pointers to an int. Then delete the pointer to
@@ -269,22 +424,23 @@ static char* test_gc_basic_alloc_free()
         ints[i] = vgc_malloc_ext(&gc, sizeof(int), dtor);
         *ints[i] = 42;
     }
-    mu_assert(gc.allocs->size == 17, "Wrong allocation map size");
+    mu_assert(_allocation_count(&gc) == 17, "Wrong allocation map size");
 
     /* Test that all managed allocations get tagged if the root is present */
     vgc_mark(&gc);
     for (size_t i=0; i < gc.allocs->capacity; ++i) {
         vgc_Allocation* chunk = gc.allocs->allocs[i];
         while (chunk) {
-            mu_assert(chunk->tag & VGC_TAG_MARK, "Referenced allocs should be marked");
+            mu_assert(vgc_allocation_is_marked(gc.allocs, chunk), "Referenced allocs should be marked");
             // reset for next test
-            chunk->tag = VGC_TAG_NONE;
+            unmark(&gc, chunk);
             chunk = chunk->next;
         }
     }
 
     /* Now drop the root allocation */
     ints = NULL;
+    _scrub_stack();
     vgc_mark(&gc);
 
     /* Check that none of the allocations get tagged */
@@ -292,7 +448,7 @@ static char* test_gc_basic_alloc_free()
     for (size_t i=0; i < gc.allocs->capacity; ++i) {
         vgc_Allocation* chunk = gc.allocs->allocs[i];
         while (chunk) {
-            mu_assert(!(chunk->tag & VGC_TAG_MARK), "Unreferenced allocs should not be marked");
+            mu_assert(!vgc_allocation_is_marked(gc.allocs, chunk), "Unreferenced allocs should not be marked");
             total += chunk->size;
             chunk = chunk->next;
         }
@@ -308,6 +464,53 @@ static char* test_gc_basic_alloc_free()
     return NULL;
 }
 
+static char* test_gc_mark_bitmaps()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start_ext(&gc, stack_bp, 32, 32, 0.0, DBL_MAX, DBL_MAX);
+
+    /* Span several pages of allocation objects */
+    size_t N = 3 * VGC_PAGE_SLOTS;
+    void** ptrs = vgc_malloc_static(&gc, N * sizeof(void*), NULL);
+    for (size_t i=0; i<N; ++i) {
+        ptrs[i] = vgc_malloc_ext(&gc, sizeof(int), dtor);
+    }
+    /* Objects bumped from the allocation span are registered in batches */
+    vgc_span_flush(&gc);
+#if !defined(VGC_THREADS)
+    /* Lock stripes take slots in batches and may leave pages partially used */
+    mu_assert(gc.allocs->page_count == 4, "Allocation objects should fill whole pages");
+#endif
+    for (size_t i=1; i<N; i+=2) {
+        ptrs[i] = NULL;
+    }
+    vgc_mark_roots(&gc);
+    size_t collected = vgc_sweep(&gc);
+    mu_assert(collected == N / 2 * sizeof(int), "Unexpected number of collected bytes");
+    mu_assert(DTOR_COUNT == N / 2, "Failed to call destructor");
+
+    /* The live bitmap mirrors the map, and sweeping clears all marks */
+    size_t live = 0;
+    for (size_t i=0; i < gc.allocs->page_count * VGC_PAGE_WORDS; ++i) {
+        live += __builtin_popcountll(gc.allocs->live[i]);
+        mu_assert(gc.allocs->marks[i] == 0, "Sweeping should clear all marks");
+    }
+    mu_assert(live == vgc_allocation_map_size(gc.allocs), "Live bitmap should match the allocation map");
+    mu_assert(live == N / 2 + 1, "Marked allocations should survive the sweep");
+
+    /* Swept slots get recycled */
+    size_t slots = gc.allocs->slot_count;
+    vgc_malloc(&gc, sizeof(int));
+    vgc_span_flush(&gc);
+    mu_assert(gc.allocs->slot_count == slots, "New allocations should reuse swept slots");
+
+    DTOR_COUNT = 0;
+    vgc_stop(&gc);
+    return NULL;
+}
+
 static void _create_static_allocs(vgc_GC* gc,
                                   size_t count,
                                   size_t size)
@@ -340,7 +543,7 @@ static char* test_gc_static_allocation()
     for (size_t i=0; i < gc.allocs->capacity; ++i) {
         vgc_Allocation* chunk = gc.allocs->allocs[i];
         while (chunk) {
-            mu_assert(!(chunk->tag & VGC_TAG_MARK), "Marked an unused alloc");
+            mu_assert(!vgc_allocation_is_marked(gc.allocs, chunk), "Marked an unused alloc");
             mu_assert(!(chunk->tag & VGC_TAG_ROOT), "Unrooting failed");
             total += chunk->size;
             n++;
@@ -358,6 +561,61 @@ static char* test_gc_static_allocation()
     return NULL;
 }
 
+static void* GLOBAL_SLOTS[4];
+
+static void _store_global_allocs(vgc_GC* gc)
+{
+    for (size_t i=0; i<4; ++i) {
+        GLOBAL_SLOTS[i] = vgc_malloc_ext(gc, 8, dtor);
+    }
+}
+
+static char* test_gc_root_set()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+
+    /* Static allocations are kept in the root index */
+    _create_static_allocs(&gc, 8, 16);
+    mu_assert(gc.roots->size == 8, "Static allocations should be indexed as roots");
+    void* root = vgc_malloc(&gc, 16);
+    vgc_make_static(&gc, root);
+    vgc_make_static(&gc, root);
+    mu_assert(gc.roots->size == 9, "Roots should be indexed once");
+    vgc_free(&gc, root);
+    mu_assert(gc.roots->size == 8, "Freed roots should leave the root index");
+
+    /* Registered root ranges keep their referents alive */
+    vgc_add_root_range(&gc, GLOBAL_SLOTS, GLOBAL_SLOTS + 4);
+    _store_global_allocs(&gc);
+    vgc_mark_roots(&gc);
+    for (size_t i=0; i<4; ++i) {
+        vgc_Allocation* a = vgc_allocation_map_get(gc.allocs, GLOBAL_SLOTS[i]);
+        mu_assert(vgc_allocation_is_marked(gc.allocs, a), "Referents of root ranges should be marked");
+    }
+    /* reset the tags */
+    for (size_t i=0; i < gc.allocs->capacity; ++i) {
+        for (vgc_Allocation* chunk = gc.allocs->allocs[i]; chunk; chunk = chunk->next) {
+            unmark(&gc, chunk);
+        }
+    }
+    vgc_remove_root_range(&gc, GLOBAL_SLOTS, GLOBAL_SLOTS + 4);
+    mu_assert(gc.roots->range_count == 0, "Root range should be removed");
+    vgc_unroot_roots(&gc);
+    vgc_mark_roots(&gc);
+    for (size_t i=0; i<4; ++i) {
+        vgc_Allocation* a = vgc_allocation_map_get(gc.allocs, GLOBAL_SLOTS[i]);
+        mu_assert(!vgc_allocation_is_marked(gc.allocs, a), "Removed root ranges should not be scanned");
+    }
+
+    vgc_stop(&gc);
+    mu_assert(DTOR_COUNT == 12, "Failed to call destructor");
+    DTOR_COUNT = 0;
+    return NULL;
+}
+
 static char* test_gc_realloc()
 {
     vgc_GC gc;
@@ -401,6 +659,59 @@ static char* test_gc_realloc()
     return NULL;
 }
 
+static char* test_gc_realloc_in_place()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_set_stack_scanning(&gc, false);
+    void** roots = vgc_malloc_static(&gc, sizeof(void*), NULL);
+
+    /* Moving blocks keep their allocation object */
+    roots[0] = vgc_malloc_noscan(&gc, 24, dtor);
+    vgc_Allocation* a = vgc_allocation_map_get(gc.allocs, roots[0]);
+    uint32_t slot = a->slot;
+    size_t count = _allocation_count(&gc);
+    for (size_t size = 24; size < (1 << 20); size += size / 2) {
+        roots[0] = vgc_realloc(&gc, roots[0], size);
+        mu_assert(roots[0] != NULL, "Reallocation failed");
+#if !defined(VGC_THREADS)
+        mu_assert(vgc_allocation_map_get(gc.allocs, roots[0]) == a, "Reallocation should reuse the allocation object");
+#else
+        a = vgc_allocation_map_get(gc.allocs, roots[0]);
+#endif
+        mu_assert(a->slot == slot && a->size == size, "Reallocation should update the allocation in place");
+        mu_assert((a->tag & VGC_TAG_NOSCAN) && a->dtor == dtor, "Reallocation should keep the tag and destructor");
+        mu_assert(_allocation_count(&gc) == count, "Reallocation should not add metadata");
+    }
+
+#if defined(VGC_USABLE_SIZE)
+    /* Growing into size class slack does not move a heap block (sanitizers leave no slack) */
+    void* p = vgc_calloc(&gc, 1, 20);
+    size_t usable = VGC_USABLE_SIZE(p);
+    if (usable > 20) {
+        mu_assert(vgc_realloc(&gc, p, usable) == p, "Growing into the slack should not move the block");
+        mu_assert(vgc_allocation_map_get(gc.allocs, p)->size == usable, "Wrong allocation size");
+    }
+    vgc_free(&gc, p);
+#endif
+
+#if !defined(VGC_THREADS)
+    /* Reallocating NULL allocates, so it may collect like any other allocation */
+    vgc_disable(&gc);
+    while (vgc_allocation_map_size(gc.allocs) <= gc.allocs->sweep_limit) {
+        vgc_malloc_ext(&gc, 8, dtor);
+    }
+    vgc_enable(&gc);
+    roots[0] = vgc_realloc(&gc, NULL, 8);
+    mu_assert(DTOR_COUNT > 0, "Reallocating NULL should trigger a collection");
+#endif
+
+    vgc_stop(&gc);
+    return NULL;
+}
+
 static void _create_allocs(vgc_GC* gc,
                            size_t count,
                            size_t size)
@@ -457,33 +768,1131 @@ char* test_gc_strdup()
     return NULL;
 }
 
+static char* test_gc_intern()
+{
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_set_stack_scanning(&gc, false);
+    const char** roots = vgc_malloc_static(&gc, 2 * sizeof(char*), NULL);
+
+    char buffer[32];
+    strcpy(buffer, "label");
+    roots[0] = vgc_intern(&gc, buffer);
+    mu_assert(roots[0] != buffer && strcmp(roots[0], "label") == 0, "Interning should copy the string");
+    mu_assert(vgc_intern(&gc, "label") == roots[0], "Equal strings should be interned once");
+    mu_assert(vgc_intern(&gc, "other") != roots[0], "Different strings should not be shared");
+    mu_assert(vgc_intern_count(&gc) == 2, "Wrong number of interned strings");
+    vgc_Allocation* a = vgc_allocation_map_get(gc.allocs, (void*) roots[0]);
+    mu_assert(a != NULL && (a->tag & VGC_TAG_NOSCAN), "Interned strings should not be scanned");
+
+    /* The table holds its strings weakly */
+    vgc_disable(&gc);
+    for (int i=0; i<1000; ++i) {
+        sprintf(buffer, "key-%d", i);
+        vgc_intern(&gc, buffer);
+    }
+    mu_assert(vgc_intern_count(&gc) == 1002, "Wrong number of interned strings");
+    vgc_enable(&gc);
+    vgc_collect(&gc);
+    mu_assert(vgc_intern_count(&gc) == 1, "Unreferenced interned strings should be collected");
+    mu_assert(vgc_intern(&gc, "label") == roots[0], "Referenced interned strings should survive");
+
+    /* The collector owns interned strings */
+    a = vgc_allocation_map_get(gc.allocs, (void*) roots[0]);
+    mu_assert(a != NULL && (a->tag & VGC_TAG_INTERNED), "Interned strings should be tagged");
+    vgc_free(&gc, (void*) roots[0]);
+    mu_assert(vgc_intern_count(&gc) == 1, "Freeing interned strings should be ignored");
+    errno = 0;
+    mu_assert(vgc_realloc(&gc, (void*) roots[0], 64) == NULL && errno == EINVAL,
+              "Reallocating interned strings should fail");
+    mu_assert(strcmp(roots[0], "label") == 0, "Interned strings should stay intact");
+    roots[1] = vgc_strdup(&gc, "label");
+    mu_assert(roots[1] != roots[0], "vgc_strdup() should return a private copy");
+    roots[0] = NULL;
+    vgc_collect(&gc);
+    mu_assert(vgc_intern_count(&gc) == 0, "Collected interned strings should leave the table");
+
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_compact_array()
+{
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+
+    /* Header and payload share a single managed allocation */
+    vgc_Array* array = vgc_create_compact_array(&gc, sizeof(int), 100);
+    mu_assert(array != NULL, "Compact array allocation failed");
+    mu_assert(_allocation_count(&gc) == 1, "Compact array should use a single allocation");
+    mu_assert(array->slot_count == 100, "Wrong slot count");
+    mu_assert(array->slot_size == sizeof(int), "Wrong slot size");
+    mu_assert(array->buffer->length == 100 * sizeof(int), "Wrong buffer length");
+    mu_assert((uintptr_t) array->buffer->address % VGC_CACHE_LINE_SIZE == 0,
+              "Compact array payload should be cache-line aligned");
+    vgc_Allocation* a = vgc_allocation_map_get(gc.allocs, array);
+    mu_assert(a != NULL, "Compact array should be managed by its header address");
+    mu_assert((char*) array->buffer->address + array->buffer->length <= (char*) a->ptr + a->size,
+              "Compact array payload should live inside the managed block");
+    int* ints = (int*) array->buffer->address;
+    for (int i=0; i<100; ++i) {
+        ints[i] = i;
+    }
+    mu_assert(ints[99] == 99, "Compact array payload should be writable");
+
+    vgc_Buffer* buffer = vgc_create_compact_buffer(&gc, 10);
+    mu_assert(_allocation_count(&gc) == 2, "Compact buffer should use a single allocation");
+    mu_assert(buffer->length == 10, "Wrong buffer length");
+    mu_assert((uintptr_t) buffer->address % VGC_CACHE_LINE_SIZE == 0,
+              "Compact buffer payload should be cache-line aligned");
+
+    /* Sizes that would wrap around are rejected instead of truncated */
+    errno = 0;
+    mu_assert(vgc_create_compact_array(&gc, SIZE_MAX / 2, 3) == NULL && errno == ENOMEM,
+              "Compact arrays whose payload overflows should be rejected");
+    errno = 0;
+    mu_assert(vgc_create_compact_array(&gc, 1, SIZE_MAX - 8) == NULL && errno == ENOMEM,
+              "Compact arrays whose block size overflows should be rejected");
+    errno = 0;
+    mu_assert(vgc_create_compact_buffer(&gc, SIZE_MAX - 8) == NULL && errno == ENOMEM,
+              "Compact buffers whose block size overflows should be rejected");
+    mu_assert(_allocation_count(&gc) == 2, "Rejected sizes should not allocate");
+
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_buffer_mmap()
+{
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+
+    const char *path = "test_gc_buffer_mmap.bin";
+    FILE *file = fopen(path, "w+b");
+    mu_assert(file != NULL, "Creating the mapped file failed");
+    for (int i=0; i<10000; ++i) {
+        fputc(i % 251, file);
+    }
+    fflush(file);
+    int fd = fileno(file);
+
+#if defined(VGC_MMAP)
+    /* Unaligned offsets map from the page below */
+    vgc_Buffer* buffer = vgc_create_buffer_mmap(&gc, fd, 5000, 100, VGC_MMAP_READ);
+    mu_assert(buffer != NULL, "Mapping the file failed");
+    mu_assert(buffer->length == 100, "Wrong mapped buffer length");
+    mu_assert(((unsigned char*) buffer->address)[0] == 5000 % 251, "Wrong mapped buffer contents");
+    mu_assert(((unsigned char*) buffer->address)[99] == 5099 % 251, "Wrong mapped buffer contents");
+    vgc_Allocation* a = vgc_allocation_map_get(gc.allocs, buffer);
+    mu_assert(a != NULL && (a->tag & VGC_TAG_NOSCAN), "Mapped buffer header should not be scanned");
+
+    /* Freeing the buffer unmaps the file */
+    void *page = (void *) ((uintptr_t) buffer->address & ~(uintptr_t) (sysconf(_SC_PAGESIZE) - 1));
+    vgc_free(&gc, buffer);
+    mu_assert(_allocation_count(&gc) == 0, "Mapped buffer header should be freed");
+    mu_assert(msync(page, 1, MS_ASYNC) == -1 && errno == ENOMEM, "Mapped file should be unmapped");
+
+    /* Writable mappings write through to the file, length 0 maps to its end */
+    buffer = vgc_create_buffer_mmap(&gc, fd, 9000, 0, VGC_MMAP_WRITE);
+    mu_assert(buffer != NULL && buffer->length == 1000, "Mapping to the end of the file failed");
+    ((unsigned char*) buffer->address)[0] = 42;
+    vgc_free(&gc, buffer);
+    fseek(file, 9000, SEEK_SET);
+    mu_assert(fgetc(file) == 42, "Writes to a shared mapping should reach the file");
+
+    mu_assert(vgc_create_buffer_mmap(&gc, fd, 10000, 0, VGC_MMAP_READ) == NULL,
+              "Mapping past the end of the file should fail");
+#else
+    mu_assert(vgc_create_buffer_mmap(&gc, fd, 0, 100, VGC_MMAP_READ) == NULL,
+              "File-backed buffers should not be available without mmap()");
+#endif
+
+    fclose(file);
+    remove(path);
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_slice()
+{
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_set_stack_scanning(&gc, false);
+    void** roots = vgc_malloc_static(&gc, 2 * sizeof(void*), NULL);
+
+    vgc_Buffer* buffer = vgc_create_buffer(&gc, 100);
+    vgc_Slice* slice = vgc_create_slice(&gc, buffer, 10, 20);
+    mu_assert(slice != NULL, "Slice allocation failed");
+    mu_assert(slice->parent == buffer, "Wrong slice parent");
+    mu_assert(slice->address == (char*) buffer->address + 10, "Wrong slice address");
+    mu_assert(slice->length == 20, "Wrong slice length");
+    mu_assert(vgc_create_slice(&gc, buffer, 90, 20) == NULL, "Slices should not exceed their buffer");
+    vgc_Slice* sub = vgc_create_subslice(&gc, slice, 5, 15);
+    mu_assert(sub != NULL && sub->parent == buffer, "Subslices should share the parent");
+    mu_assert(sub->address == (char*) buffer->address + 15, "Wrong subslice address");
+    mu_assert(vgc_create_subslice(&gc, slice, 5, 16) == NULL, "Subslices should not exceed their slice");
+
+    /* Only the subslice is referenced, it keeps the buffer and its payload alive */
+    roots[0] = sub;
+    mu_assert(vgc_collect(&gc) == sizeof(vgc_Slice), "Only the unreferenced slice should be collected");
+    mu_assert(vgc_allocation_map_get(gc.allocs, buffer), "A slice should keep its buffer alive");
+    mu_assert(vgc_allocation_map_get(gc.allocs, buffer->address), "A slice should keep the payload alive");
+    roots[0] = NULL;
+    mu_assert(vgc_collect(&gc) == sizeof(vgc_Slice) + sizeof(vgc_Buffer) + 100,
+              "Unreferenced slices should not keep their buffer alive");
+
+    vgc_Array* array = vgc_create_array(&gc, sizeof(int), 10);
+    roots[0] = vgc_create_array_slice(&gc, array, 2, 5);
+    mu_assert(((vgc_Slice*) roots[0])->address == (char*) array->buffer->address + 2 * sizeof(int),
+              "Wrong array slice address");
+    mu_assert(((vgc_Slice*) roots[0])->length == 5 * sizeof(int), "Wrong array slice length");
+    mu_assert(vgc_create_array_slice(&gc, array, 8, 5) == NULL, "Slices should not exceed their array");
+
+    /* Splitting a buffer takes a single allocation */
+    buffer = vgc_create_buffer(&gc, 100);
+    size_t size = _allocation_count(&gc);
+    vgc_Array* records = vgc_split_buffer(&gc, buffer, 30);
+    mu_assert(_allocation_count(&gc) == size + 1, "Splitting should use a single allocation");
+    mu_assert(records->slot_count == 4, "Wrong record count");
+    vgc_Slice* slices = (vgc_Slice*) records->buffer->address;
+    mu_assert(slices[1].address == (char*) buffer->address + 30, "Wrong record address");
+    mu_assert(slices[3].length == 10, "The last record should hold the remainder");
+    roots[1] = records;
+    vgc_collect(&gc);
+    mu_assert(vgc_allocation_map_get(gc.allocs, buffer), "Records should keep their buffer alive");
+    mu_assert(vgc_allocation_map_get(gc.allocs, array), "Array slices should keep their array alive");
+
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_vector()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_set_stack_scanning(&gc, false);
+    void** roots = vgc_malloc_static(&gc, 2 * sizeof(void*), NULL);
+
+    vgc_Vector* ints = vgc_create_vector_noscan(&gc, sizeof(int), 0);
+    roots[0] = ints;
+    mu_assert(ints->array.slot_count == 0 && ints->buffer.address == NULL, "New vectors should be empty");
+    for (int i=0; i<1000; ++i) {
+        mu_assert(vgc_vector_push(&gc, ints, &i) != NULL, "Push failed");
+    }
+    mu_assert(ints->array.slot_count == 1000, "Wrong vector length");
+    mu_assert(ints->buffer.length == 1024 * sizeof(int), "Vectors should grow geometrically");
+    mu_assert(vgc_vector_at(ints, int, 999) == 999, "Wrong vector contents");
+    vgc_Allocation* a = vgc_allocation_map_get(gc.allocs, ints->buffer.address);
+    mu_assert(a != NULL && (a->tag & VGC_TAG_NOSCAN), "Pointer-free vector storage should not be scanned");
+
+    int last;
+    mu_assert(vgc_vector_pop(ints, &last) && last == 999, "Pop should return the last item");
+    mu_assert(vgc_vector_shrink(&gc, ints), "Shrinking failed");
+    mu_assert(ints->buffer.length == 999 * sizeof(int), "Shrinking should release the unused storage");
+    mu_assert(vgc_vector_reserve(&gc, ints, 2000), "Reserving failed");
+    mu_assert(ints->buffer.length == 2000 * sizeof(int), "Wrong reserved capacity");
+    mu_assert(vgc_vector_at(ints, int, 998) == 998, "Growing should keep the contents");
+    vgc_vector_clear(ints);
+    mu_assert(ints->array.slot_count == 0 && ints->buffer.length == 2000 * sizeof(int),
+              "Clearing should keep the storage");
+    mu_assert(vgc_vector_shrink(&gc, ints) && ints->buffer.address == NULL, "Empty vectors should hold no storage");
+
+    /* Scanned vectors keep their items alive, popped items are released */
+    vgc_Vector* objects = vgc_create_vector(&gc, sizeof(void*), 2);
+    roots[1] = objects;
+    for (int i=0; i<3; ++i) {
+        void* object = vgc_malloc_ext(&gc, 16, dtor);
+        vgc_vector_push(&gc, objects, &object);
+    }
+    vgc_collect(&gc);
+    mu_assert(DTOR_COUNT == 0, "Vector items should be kept alive");
+    vgc_vector_pop(objects, NULL);
+    vgc_collect(&gc);
+    mu_assert(DTOR_COUNT == 1, "Popped items should not be kept alive");
+
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_region()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+
+    /* Region allocations bypass the allocation map */
+    vgc_region_begin(&gc);
+    for (size_t i=0; i<1000; ++i) {
+        int* p = vgc_malloc(&gc, sizeof(int));
+        *p = (int) i;
+    }
+    vgc_malloc_ext(&gc, 64, dtor);
+    int* big = vgc_calloc(&gc, VGC_SPAN_SIZE, sizeof(int));
+    mu_assert(big[VGC_SPAN_SIZE - 1] == 0, "Region calloc should zero memory");
+    mu_assert(_allocation_count(&gc) == 0, "Region objects should not enter the allocation map");
+    size_t released = vgc_region_end(&gc);
+    mu_assert(gc.region == NULL, "Ending the only region should leave no region active");
+    mu_assert(released >= 1000 * sizeof(int) + 64 + VGC_SPAN_SIZE * sizeof(int),
+              "Region end should release all region memory");
+    mu_assert(DTOR_COUNT == 1, "Region end should finalize region objects");
+
+    /* Promoted objects, and what they reference, survive the region */
+    DTOR_COUNT = 0;
+    vgc_region_begin(&gc);
+    int** pair = vgc_malloc_ext(&gc, 2 * sizeof(int*), dtor);
+    pair[0] = vgc_malloc(&gc, sizeof(int));
+    *pair[0] = 42;
+    mu_assert(vgc_region_promote(&gc, pair) == pair, "Promotion should not move objects");
+    mu_assert(_allocation_count(&gc) == 2, "Promotion should be transitive");
+    pair[1] = vgc_malloc(&gc, sizeof(int));
+    *pair[1] = 7;
+    vgc_region_end(&gc);
+    mu_assert(DTOR_COUNT == 0, "Promoted objects should not be finalized at region end");
+    mu_assert(_allocation_count(&gc) == 3, "Late references from promoted objects should escape too");
+    mu_assert(*pair[0] == 42 && *pair[1] == 7, "Promoted objects should keep their contents");
+    vgc_free(&gc, pair[0]);
+    vgc_free(&gc, pair[1]);
+    vgc_free(&gc, pair);
+    mu_assert(DTOR_COUNT == 1, "Freeing promoted objects should finalize them");
+    mu_assert(_allocation_count(&gc) == 0, "Freed promoted objects should leave the allocation map");
+
+    /* Region objects referenced from roots escape on their own */
+    DTOR_COUNT = 0;
+    void** root = vgc_malloc_static(&gc, sizeof(void*), NULL);
+    vgc_ShadowRoot shadow;
+    vgc_region_begin(&gc);
+    /* Promoted objects are scanned, so keep stale words out of them */
+    *root = vgc_calloc_ext(&gc, 1, 16, dtor);
+    shadow.ptr = vgc_calloc_ext(&gc, 1, 16, dtor);
+    vgc_add_shadow_root(&gc, &shadow);
+    vgc_malloc_ext(&gc, 16, dtor);
+    vgc_region_end(&gc);
+    mu_assert(DTOR_COUNT == 1, "Only unreferenced region objects should be finalized");
+    mu_assert(vgc_allocation_map_get(gc.allocs, *root), "Objects referenced from roots should be promoted");
+    mu_assert(vgc_allocation_map_get(gc.allocs, shadow.ptr), "Objects referenced from shadow roots should be promoted");
+    vgc_remove_shadow_root(&gc, &shadow);
+    vgc_free(&gc, shadow.ptr);
+    vgc_free(&gc, *root);
+    vgc_free(&gc, root);
+
+    /* Reallocated region objects keep their destructor, and many spans can be told apart */
+    DTOR_COUNT = 0;
+    vgc_region_begin(&gc);
+    void* grown = vgc_malloc_ext(&gc, 16, dtor);
+    grown = vgc_realloc(&gc, grown, 4 * VGC_SPAN_SIZE);
+    mu_assert(vgc_span_object_get(&gc, grown) != NULL, "Reallocated region objects should stay in the region");
+    for (size_t i=0; i<64; ++i) {
+        void* p = vgc_malloc(&gc, VGC_SPAN_SIZE / 2);
+        mu_assert(vgc_span_object_get(&gc, p) != NULL, "Every span should be found");
+        mu_assert(vgc_span_object_get(&gc, (char*) p + VGC_SPAN_GRANULE) == NULL, "Interior pointers should be rejected");
+    }
+    mu_assert(gc.region->span_count >= 64, "Every span should be indexed");
+    vgc_region_end(&gc);
+    mu_assert(DTOR_COUNT == 1, "Reallocation should move the destructor along");
+
+    DTOR_COUNT = 0;
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_region_nested()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+
+    /* Promoting a long chain does not recurse once per object */
+    vgc_region_begin(&gc);
+    void** head = NULL;
+    for (size_t i=0; i<(1 << 18); ++i) {
+        void** node = vgc_malloc(&gc, sizeof(void*));
+        *node = head;
+        head = node;
+    }
+    mu_assert(vgc_region_promote(&gc, head) == head, "Promoting a long chain failed");
+    mu_assert(_allocation_count(&gc) == (1 << 18), "Every object of the chain should be promoted");
+    vgc_region_end(&gc);
+
+    /* Objects of enclosing regions keep what they reference in an inner region alive */
+    vgc_region_begin(&gc);
+    void** outer = vgc_calloc(&gc, 2, sizeof(void*));
+    vgc_region_begin(&gc);
+    outer[0] = vgc_calloc_ext(&gc, 1, 16, dtor);
+    ((void**) outer[0])[0] = vgc_calloc_ext(&gc, 1, 16, dtor);
+    vgc_malloc_ext(&gc, 16, dtor);
+    vgc_region_end(&gc);
+    mu_assert(DTOR_COUNT == 1, "Only inner objects that nothing references should be finalized");
+    mu_assert(vgc_allocation_map_get(gc.allocs, outer[0]), "Inner objects referenced from enclosing regions should be promoted");
+    mu_assert(vgc_allocation_map_get(gc.allocs, ((void**) outer[0])[0]), "Promotion from enclosing regions should be transitive");
+    mu_assert(!vgc_allocation_map_get(gc.allocs, outer), "Objects of enclosing regions should stay in their region");
+    vgc_region_end(&gc);
+
+    DTOR_COUNT = 0;
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_malloc_fast()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_disable(&gc);
+
+    /* Outside regions, the fast path bumps the allocation span */
+    void* tracked = vgc_malloc_fast(&gc, 16, NULL);
+#if !defined(VGC_THREADS)
+    mu_assert(gc.span && (char*) tracked >= gc.span->data && (char*) tracked < gc.span->data + gc.span->used,
+              "Allocations outside regions should come from the allocation span");
+#endif
+    mu_assert(vgc_allocation_get(&gc, tracked) != NULL, "Allocations outside regions should be tracked");
+
+    /* Inside a region, it bumps the current span, also once it is exhausted */
+    vgc_region_begin(&gc);
+    void* first = vgc_malloc_fast(&gc, 24, dtor);
+    mu_assert(vgc_span_object_get(&gc, first) != NULL, "Region allocations should come from a span");
+    vgc_Span* span = gc.region->spans;
+    for (size_t i=0; i<VGC_SPAN_SIZE / 32; ++i) {
+        int* p = vgc_malloc_fast(&gc, sizeof(int), NULL);
+        *p = (int) i;
+        mu_assert(((uintptr_t) p) % VGC_SPAN_GRANULE == 0, "Span objects should be granule aligned");
+    }
+    mu_assert(gc.region->spans != span, "An exhausted span should be replaced");
+    mu_assert(_allocation_count(&gc) == 1, "Region objects should not enter the allocation map");
+    vgc_region_end(&gc);
+    mu_assert(DTOR_COUNT == 1, "Region end should finalize fast path objects");
+
+    vgc_stop(&gc);
+    return NULL;
+}
+
+#if !defined(VGC_THREADS)
+static char* test_gc_allocation_span()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_disable(&gc);
+
+    /* Objects are bumped back to back and only registered in batches */
+    int* first = vgc_malloc_ext(&gc, sizeof(int), dtor);
+    int* second = vgc_malloc_ext(&gc, sizeof(int), dtor);
+    mu_assert(gc.span != NULL && gc.span->owned, "Allocating should start an allocation span");
+    mu_assert((char*) second > (char*) first &&
+              (size_t) ((char*) second - (char*) first) <= sizeof(vgc_SpanObject) + 2 * VGC_SPAN_GRANULE,
+              "Span objects should be adjacent");
+    mu_assert(*first == 0 && *second == 0, "Span memory should start out zeroed");
+    mu_assert(vgc_allocation_map_size(gc.allocs) == 0, "Bumped objects should not be registered right away");
+    mu_assert(vgc_allocation_get(&gc, second) != NULL && vgc_allocation_map_size(gc.allocs) == 2,
+              "Looking up a bumped object should register the span");
+
+    /* Objects that are not registered yet can be freed and resized */
+    int* third = vgc_malloc_ext(&gc, sizeof(int), dtor);
+    vgc_free(&gc, third);
+    mu_assert(DTOR_COUNT == 1 && vgc_allocation_map_size(gc.allocs) == 2, "Freeing a bumped object should finalize it");
+    int* moved = vgc_malloc(&gc, sizeof(int));
+    *moved = 7;
+    moved = vgc_realloc(&gc, moved, 1024);
+    vgc_Allocation* a = vgc_allocation_map_get(gc.allocs, moved);
+    mu_assert(a != NULL && !(a->tag & VGC_TAG_SPAN) && *moved == 7, "Growing a bumped object should move it");
+    vgc_free(&gc, moved);
+
+    /* An exhausted span is registered as a whole and retired */
+    vgc_Span* span = gc.span;
+    size_t count = 0;
+    while (gc.span == span) {
+        vgc_malloc_ext(&gc, 16, dtor);
+        count++;
+    }
+    mu_assert(!span->owned && span->refs == count + 1, "An exhausted span should be retired");
+    mu_assert(vgc_allocation_map_size(gc.allocs) == count + 1, "Retiring a span should register all of its objects");
+
+    /* Collections are only considered when a span is exhausted */
+    vgc_enable(&gc);
+    size_t before = DTOR_COUNT;
+    for (;;) {
+        span = gc.span;
+        vgc_malloc_ext(&gc, 16, dtor);
+        if (DTOR_COUNT != before) {
+            break;
+        }
+    }
+    mu_assert(gc.span != span, "Collections should be triggered by exhausting a span");
+
+    /* Pooled memory is recycled block by block, so pools retire the span */
+    mu_assert(vgc_add_pool(&gc, 32, 1024) && gc.span == NULL, "Adding a pool should retire the allocation span");
+    void* pooled = vgc_malloc(&gc, 32);
+    mu_assert(gc.span == NULL && !(vgc_allocation_map_get(gc.allocs, pooled)->tag & VGC_TAG_SPAN),
+              "Pooled collectors should allocate from the heap");
+
+    vgc_stop(&gc);
+    DTOR_COUNT = 0;
+    return NULL;
+}
+#endif
+
+static char* test_gc_shadow_roots()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_set_stack_scanning(&gc, false);
+
+    /* Only shadow roots keep objects alive once the stack is not scanned */
+    vgc_ShadowRoot a, b;
+    a.ptr = vgc_malloc_ext(&gc, 16, dtor);
+    b.ptr = vgc_malloc_ext(&gc, 16, dtor);
+    void** head = a.ptr;
+    *head = vgc_malloc_ext(&gc, 16, dtor);
+    vgc_malloc_ext(&gc, 16, dtor);
+    vgc_add_shadow_root(&gc, &a);
+    vgc_add_shadow_root(&gc, &b);
+    mu_assert(vgc_collect(&gc) == 16, "Unrooted objects should be collected");
+    mu_assert(DTOR_COUNT == 1, "Unrooted objects should be finalized");
+    mu_assert(_allocation_count(&gc) == 3, "Shadow-rooted objects and their referents should survive");
+
+    /* Roots can be removed in any order */
+    vgc_remove_shadow_root(&gc, &a);
+    mu_assert(vgc_collect(&gc) == 32, "Unregistered roots should not keep objects alive");
+    b.ptr = NULL;
+    mu_assert(vgc_collect(&gc) == 16, "Cleared roots should not keep objects alive");
+    vgc_remove_shadow_root(&gc, &b);
+    mu_assert(gc.roots->shadow == NULL, "No shadow roots should be left");
+    mu_assert(_allocation_count(&gc) == 0, "Every object should be collected");
+
+    DTOR_COUNT = 0;
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_noscan()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_set_stack_scanning(&gc, false);
+
+    /* A pointer stored in noscan memory does not keep its target alive */
+    void** scanned = vgc_malloc_static(&gc, sizeof(void*), NULL);
+    void** noscan = vgc_make_static(&gc, vgc_malloc_noscan(&gc, sizeof(void*), NULL));
+    *scanned = vgc_malloc_ext(&gc, 16, dtor);
+    *noscan = vgc_malloc_ext(&gc, 16, dtor);
+    mu_assert(vgc_collect(&gc) == 16, "Noscan memory should not be scanned");
+    mu_assert(DTOR_COUNT == 1, "Objects only referenced from noscan memory should be finalized");
+    mu_assert(vgc_allocation_map_get(gc.allocs, *scanned), "Objects referenced from scanned memory should survive");
+
+    /* Reallocation keeps the tag */
+    noscan = vgc_realloc(&gc, noscan, 4096);
+    noscan[0] = vgc_malloc_ext(&gc, 16, dtor);
+    mu_assert(vgc_collect(&gc) == 16, "Reallocated noscan memory should not be scanned");
+    mu_assert(DTOR_COUNT == 2, "Wrong destructor count");
+
+    DTOR_COUNT = 0;
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_trace()
+{
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_TraceEvent events[8];
+    mu_assert(vgc_trace_read(&gc, events, 8) == 0, "Nothing should be recorded without a trace");
+    mu_assert(vgc_trace_start(&gc, 5), "Starting the trace failed");
+    mu_assert(gc.trace->mask == 7, "The capacity should be rounded up to a power of two");
+
+    vgc_collect(&gc);
+    mu_assert(vgc_trace_read(&gc, events, 8) == 3, "A collection should record three events");
+    mu_assert(events[0].type == VGC_TRACE_COLLECT_BEGIN, "Wrong first event");
+    mu_assert(events[1].type == VGC_TRACE_MARK_END, "Wrong second event");
+    mu_assert(events[2].type == VGC_TRACE_SWEEP_END, "Wrong third event");
+    mu_assert(events[0].time <= events[2].time, "Events should be ordered by time");
+
+    /* Once full, the ring keeps only the most recent events */
+    vgc_region_begin(&gc);
+    vgc_malloc(&gc, 64);
+    vgc_region_end(&gc);
+    vgc_collect(&gc);
+    vgc_collect(&gc);
+    mu_assert(vgc_trace_read(&gc, events, 8) == 8, "The ring should be full");
+    mu_assert(events[7].type == VGC_TRACE_SWEEP_END, "Wrong newest event");
+    mu_assert(events[0].type == VGC_TRACE_REGION_BEGIN, "The oldest events should be overwritten");
+    mu_assert(events[1].type == VGC_TRACE_REGION_END && events[1].a > 0,
+              "The region end should record the released bytes");
+    mu_assert(vgc_trace_read(&gc, events, 2) == 2 && events[0].type == VGC_TRACE_MARK_END,
+              "A short read should return the newest events");
+
+    const char *path = "test_gc_trace.bin";
+    mu_assert(vgc_trace_dump(&gc, path), "Dumping the trace failed");
+    FILE *file = fopen(path, "rb");
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fclose(file);
+    remove(path);
+    mu_assert(length == 8 * (long) sizeof(vgc_TraceEvent), "The dump should hold every recorded event");
+
+    vgc_stop(&gc);
+    mu_assert(gc.trace == NULL, "Stopping should release the trace");
+    return NULL;
+}
+
+static char* test_gc_record()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    const char *path = "test_gc_record.bin";
+#if defined(VGC_THREADS)
+    mu_assert(!vgc_record_start(&gc, path, true), "Recording should not be available with threads");
+#else
+    mu_assert(vgc_record_start(&gc, path, true), "Starting the recorder failed");
+    mu_assert(!vgc_record_start(&gc, path, true), "Only one recorder should be active");
+
+    void** a = vgc_malloc_ext(&gc, 2 * sizeof(void*), dtor);
+    a[0] = vgc_calloc(&gc, 4, sizeof(int));
+    a[1] = NULL;
+    a[0] = vgc_realloc(&gc, a[0], 64 * sizeof(int));
+    vgc_free(&gc, vgc_malloc(&gc, 8));
+    vgc_make_static(&gc, a);
+    vgc_collect(&gc);
+    vgc_collect(&gc);
+    mu_assert(vgc_record_stop(&gc), "Stopping the recorder failed");
+    mu_assert(gc.recorder == NULL, "Stopping should release the recorder");
+
+    FILE *file = fopen(path, "rb");
+    char magic[sizeof(VGC_RECORD_MAGIC)];
+    mu_assert(fread(magic, sizeof(magic), 1, file) == 1 && strcmp(magic, VGC_RECORD_MAGIC) == 0,
+              "The trace should start with the magic bytes");
+    vgc_RecordEvent events[64];
+    size_t count = fread(events, sizeof(vgc_RecordEvent), 64, file);
+    fclose(file);
+    remove(path);
+    mu_assert(count >= 9, "Wrong number of events");
+    mu_assert(events[0].type == VGC_RECORD_MALLOC && events[0].flags == VGC_RECORD_DTOR
+              && events[0].size == 2 * sizeof(void*), "Wrong malloc event");
+    mu_assert(events[1].type == VGC_RECORD_CALLOC && events[1].flags == 0, "Wrong calloc event");
+    mu_assert(events[2].type == VGC_RECORD_REALLOC && events[2].arg == events[1].id
+              && events[2].size == 64 * sizeof(int), "Wrong realloc event");
+    mu_assert(events[3].type == VGC_RECORD_MALLOC && events[4].type == VGC_RECORD_FREE
+              && events[4].id == events[3].id, "Wrong free event");
+    mu_assert(events[5].type == VGC_RECORD_COLLECT && !(events[5].flags & VGC_RECORD_AUTO),
+              "Wrong collect event");
+    /* Both live objects are new, so their contents are recorded */
+    bool edge = false;
+    size_t contents = 0;
+    for (size_t i=6; i<count-1; ++i) {
+        mu_assert(events[i].type == VGC_RECORD_CONTENTS || events[i].type == VGC_RECORD_EDGE,
+                  "Only the graph should follow the collect event");
+        contents += events[i].type == VGC_RECORD_CONTENTS;
+        edge |= events[i].type == VGC_RECORD_EDGE && events[i].id == events[0].id
+                && events[i].size == 0 && events[i].arg == events[2].id;
+    }
+    mu_assert(contents == 2, "Wrong number of contents events");
+    mu_assert(edge, "The edge between the objects should be recorded");
+    mu_assert(events[count-1].type == VGC_RECORD_COLLECT, "Unchanged objects should not be recorded again");
+#endif
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static char* test_gc_pool()
+{
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+#if defined(VGC_THREADS)
+    mu_assert(!vgc_add_pool(&gc, 32, 4 * 32), "Pools should not be available with threads");
+#else
+    vgc_set_stack_scanning(&gc, false);
+    mu_assert(!vgc_add_pool(&gc, 1, 64), "Pooled blocks must hold a pointer");
+    mu_assert(vgc_add_pool(&gc, 32, 4 * 32), "Adding a pool failed");
+
+    /* Swept allocations of the pooled size are recycled up to the limit */
+    void* swept[10];
+    for (size_t i=0; i<10; ++i) {
+        swept[i] = vgc_malloc(&gc, 32);
+    }
+    vgc_malloc(&gc, 48);
+    mu_assert(vgc_collect(&gc) == 10 * 32 + 48, "Pooled allocations should count as collected");
+    mu_assert(gc.pools[0].count == 4, "The pool should stop at its limit");
+    int* p = vgc_calloc(&gc, 8, sizeof(int));
+    bool recycled = false;
+    for (size_t i=0; i<10; ++i) {
+        recycled |= p == swept[i];
+    }
+    mu_assert(recycled, "Allocations should be served from the pool");
+    for (size_t i=0; i<8; ++i) {
+        mu_assert(p[i] == 0, "Recycled calloc memory should be zeroed");
+    }
+    mu_assert(gc.pools[0].count == 3, "Wrong pool size");
+    mu_assert(vgc_calloc(&gc, ((size_t) 1 << (sizeof(size_t) * 8 - 1)) + 16, 2) == NULL,
+              "Overflowing calloc sizes should not be served from a pool");
+    mu_assert(gc.pools[0].count == 3, "Overflowing calloc sizes should not take from the pool");
+    vgc_free(&gc, p);
+    mu_assert(gc.pools[0].count == 4, "Freed allocations should be recycled");
+
+    /* Lowering the limit trims the pool */
+    mu_assert(vgc_add_pool(&gc, 32, 32), "Updating a pool failed");
+    mu_assert(gc.pool_count == 1 && gc.pools[0].count == 1, "The pool should be trimmed");
+#endif
+
+    vgc_stop(&gc);
+    mu_assert(gc.pools == NULL, "Stopping should release the pools");
+    return NULL;
+}
+
+static char* test_gc_weak()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+    vgc_set_stack_scanning(&gc, false);
+
+    /* Weak references are cleared when their target is collected */
+    vgc_ShadowRoot target, refs;
+    target.ptr = vgc_malloc_ext(&gc, 16, dtor);
+    vgc_add_shadow_root(&gc, &target);
+    vgc_WeakRef** ref = vgc_malloc(&gc, 2 * sizeof(vgc_WeakRef*));
+    ref[0] = vgc_create_weak_ref(&gc, target.ptr);
+    ref[1] = vgc_create_weak_ref(&gc, vgc_malloc_ext(&gc, 16, dtor));
+    refs.ptr = ref;
+    vgc_add_shadow_root(&gc, &refs);
+    mu_assert(vgc_create_weak_ref(&gc, &target) == NULL, "Weak references need a managed target");
+    vgc_collect(&gc);
+    mu_assert(DTOR_COUNT == 1, "Weak references should not keep their target alive");
+    mu_assert(vgc_weak_ref_get(ref[0]) == target.ptr, "Live targets should stay referenced");
+    mu_assert(vgc_weak_ref_get(ref[1]) == NULL, "Collected targets should be cleared");
+    target.ptr = vgc_realloc(&gc, target.ptr, 4096);
+    mu_assert(vgc_weak_ref_get(ref[0]) == target.ptr, "Reallocation should retarget weak references");
+    vgc_free(&gc, target.ptr);
+    mu_assert(vgc_weak_ref_get(ref[0]) == NULL, "Freeing a target should clear its weak references");
+    /* The freed block may be handed out again */
+    vgc_remove_shadow_root(&gc, &target);
+
+    /* Weak map values live as long as their keys, even through other values. The
+     * objects are zeroed, so that stale words cannot keep unreachable keys alive. */
+    vgc_ShadowRoot map, key;
+    map.ptr = vgc_create_weak_map(&gc);
+    key.ptr = vgc_calloc(&gc, 1, 16);
+    vgc_add_shadow_root(&gc, &map);
+    vgc_add_shadow_root(&gc, &key);
+    void* value = vgc_calloc(&gc, 1, 16);
+    mu_assert(vgc_weak_map_put(map.ptr, key.ptr, value), "Managed keys should be accepted");
+    mu_assert(vgc_weak_map_put(map.ptr, value, vgc_calloc_ext(&gc, 1, 16, dtor)), "Values can be keys");
+    for (size_t i=0; i<100; ++i) {
+        mu_assert(vgc_weak_map_put(map.ptr, vgc_calloc(&gc, 1, 16), vgc_calloc_ext(&gc, 1, 16, dtor)), "Put failed");
+    }
+    mu_assert(!vgc_weak_map_put(map.ptr, &key, value), "Weak maps need managed keys");
+    mu_assert(vgc_weak_map_size(map.ptr) == 102, "Wrong weak map size");
+    DTOR_COUNT = 0;
+    vgc_collect(&gc);
+    mu_assert(DTOR_COUNT == 100, "Entries with unreachable keys should be collected");
+    mu_assert(vgc_weak_map_size(map.ptr) == 2, "Entries with unreachable keys should be dropped");
+    mu_assert(vgc_weak_map_get(map.ptr, key.ptr) == value, "Reachable keys should keep their value");
+    mu_assert(vgc_allocation_map_get(gc.allocs, vgc_weak_map_get(map.ptr, value)),
+              "Values reachable through other values should survive");
+    mu_assert(vgc_weak_map_remove(map.ptr, value), "Remove failed");
+    mu_assert(!vgc_weak_map_remove(map.ptr, value), "Removing twice should fail");
+    vgc_remove_shadow_root(&gc, &key);
+    vgc_collect(&gc);
+    mu_assert(vgc_weak_map_size(map.ptr) == 0, "The map should be empty");
+
+    /* Unreachable weak objects unregister themselves */
+    vgc_remove_shadow_root(&gc, &refs);
+    vgc_remove_shadow_root(&gc, &map);
+    vgc_collect(&gc);
+    mu_assert(gc.weak_refs == NULL && gc.weak_maps == NULL, "Weak objects should be collected");
+    mu_assert(_allocation_count(&gc) == 0, "Every object should be collected");
+
+    DTOR_COUNT = 0;
+    vgc_stop(&gc);
+    return NULL;
+}
+
+#if defined(__linux__)
+#include <ucontext.h>
+
+#define FIBER_STACK_SIZE (64 * 1024)
+
+static vgc_GC FIBER_GC;
+static vgc_Stack FIBER_MAIN_STACK, FIBER_STACK;
+static ucontext_t FIBER_MAIN_CTX, FIBER_CTX;
+
+static void _fiber()
+{
+    /* Only this fiber's stack refers to the object */
+    void* volatile obj = vgc_malloc_ext(&FIBER_GC, 16, dtor);
+    vgc_switch_stack(&FIBER_GC, &FIBER_STACK, &FIBER_MAIN_STACK);
+    swapcontext(&FIBER_CTX, &FIBER_MAIN_CTX);
+    UNUSED(obj);
+}
+
+static char* test_gc_stacks()
+{
+    DTOR_COUNT = 0;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&FIBER_GC, stack_bp);
+
+    char* fiber_stack = malloc(FIBER_STACK_SIZE);
+    getcontext(&FIBER_CTX);
+    FIBER_CTX.uc_stack.ss_sp = fiber_stack;
+    FIBER_CTX.uc_stack.ss_size = FIBER_STACK_SIZE;
+    FIBER_CTX.uc_link = &FIBER_MAIN_CTX;
+    makecontext(&FIBER_CTX, _fiber, 0);
+    vgc_add_stack(&FIBER_GC, &FIBER_MAIN_STACK, stack_bp, NULL);
+    vgc_add_stack(&FIBER_GC, &FIBER_STACK, fiber_stack + FIBER_STACK_SIZE, NULL);
+
+    vgc_switch_stack(&FIBER_GC, &FIBER_MAIN_STACK, &FIBER_STACK);
+    swapcontext(&FIBER_MAIN_CTX, &FIBER_CTX);
+    mu_assert(FIBER_GC.stack_bp == stack_bp, "Switching back should restore the main stack");
+    mu_assert(FIBER_STACK.sp > (void*) fiber_stack && FIBER_STACK.sp < (void*) (fiber_stack + FIBER_STACK_SIZE),
+              "The suspended fiber should have saved its stack pointer");
+    mu_assert(vgc_collect(&FIBER_GC) == 0, "Suspended stacks should be scanned");
+    mu_assert(DTOR_COUNT == 0, "Objects referenced from suspended stacks should survive");
+
+    vgc_remove_stack(&FIBER_GC, &FIBER_STACK);
+    mu_assert(vgc_collect(&FIBER_GC) == 16, "Removed stacks should not be scanned");
+    mu_assert(DTOR_COUNT == 1, "Wrong destructor count");
+    vgc_remove_stack(&FIBER_GC, &FIBER_MAIN_STACK);
+    mu_assert(FIBER_GC.stacks == NULL, "No stacks should be left");
+
+    free(fiber_stack);
+    DTOR_COUNT = 0;
+    vgc_stop(&FIBER_GC);
+    return NULL;
+}
+#endif
+
+#if defined(VGC_THREADS)
+#include <pthread.h>
+
+#define THREAD_COUNT 8
+#define THREAD_OBJECTS 20000
+
+static vgc_GC THREAD_GC;
+static void* THREAD_SLOTS[THREAD_COUNT][THREAD_OBJECTS];
+static size_t THREAD_DTOR_COUNT = 0;
+
+static void _thread_dtor(void* ptr)
+{
+    UNUSED(ptr);
+    __atomic_fetch_add(&THREAD_DTOR_COUNT, 1, __ATOMIC_RELAXED);
+}
+
+static void* _thread_alloc(void* arg)
+{
+    void** slots = (void**) arg;
+    for (size_t i=0; i<THREAD_OBJECTS; ++i) {
+        slots[i] = vgc_malloc_ext(&THREAD_GC, 8 + i % 64, _thread_dtor);
+        /* Free some of our own objects right away */
+        if (i % 4 == 3) {
+            vgc_free(&THREAD_GC, slots[i - 1]);
+            slots[i - 1] = NULL;
+        }
+    }
+    return NULL;
+}
+
+static void* _thread_free(void* arg)
+{
+    void** slots = (void**) arg;
+    for (size_t i=0; i<THREAD_OBJECTS; ++i) {
+        if (slots[i]) {
+            vgc_free(&THREAD_GC, slots[i]);
+        }
+    }
+    return NULL;
+}
+
+static char* test_gc_threads()
+{
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&THREAD_GC, stack_bp);
+
+    pthread_t threads[THREAD_COUNT];
+    for (size_t t=0; t<THREAD_COUNT; ++t) {
+        pthread_create(&threads[t], NULL, _thread_alloc, THREAD_SLOTS[t]);
+    }
+    for (size_t t=0; t<THREAD_COUNT; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+    size_t expected = THREAD_COUNT * (THREAD_OBJECTS - THREAD_OBJECTS / 4);
+    mu_assert(vgc_allocation_map_size(THREAD_GC.allocs) == expected, "Concurrent puts should all land in the map");
+    for (size_t t=0; t<THREAD_COUNT; ++t) {
+        for (size_t i=0; i<THREAD_OBJECTS; ++i) {
+            mu_assert(!THREAD_SLOTS[t][i] || vgc_allocation_map_get(THREAD_GC.allocs, THREAD_SLOTS[t][i]),
+                      "Every live object should be found");
+        }
+    }
+
+    /* Hand every thread's objects to its neighbour to be freed */
+    for (size_t t=0; t<THREAD_COUNT; ++t) {
+        pthread_create(&threads[t], NULL, _thread_free, THREAD_SLOTS[(t + 1) % THREAD_COUNT]);
+    }
+    for (size_t t=0; t<THREAD_COUNT; ++t) {
+        pthread_join(threads[t], NULL);
+    }
+    mu_assert(vgc_allocation_map_size(THREAD_GC.allocs) == 0, "Concurrent removes should empty the map");
+    for (size_t s=0; s<VGC_MAP_STRIPES; ++s) {
+        mu_assert(THREAD_GC.allocs->stripes[s].size == 0, "Rehashing should move the stripe counts along");
+    }
+    mu_assert(THREAD_DTOR_COUNT == THREAD_COUNT * THREAD_OBJECTS, "Every destructor should run once");
+    size_t live = 0;
+    for (size_t w=0; w<THREAD_GC.allocs->page_count * VGC_PAGE_WORDS; ++w) {
+        live += (size_t) __builtin_popcountll(THREAD_GC.allocs->live[w]);
+    }
+    mu_assert(live == 0, "No slot should be left live");
+
+    vgc_stop(&THREAD_GC);
+    return NULL;
+}
+#endif
+
+#if defined(VGC_SNAPSHOT)
+static void _create_snapshot_garbage(vgc_GC* gc, void** objs, size_t n)
+{
+    for (size_t i=0; i<n; ++i) {
+        objs[i] = vgc_malloc_ext(gc, 16, dtor);
+    }
+    /* Only the first half stays reachable */
+    for (size_t i=n/2; i<n; ++i) {
+        objs[i] = NULL;
+    }
+}
+
+static void _create_unreachable(vgc_GC* gc)
+{
+    vgc_malloc_ext(gc, 16, dtor);
+}
+
+static char* test_gc_snapshot()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+
+    void** objs = vgc_malloc_static(&gc, 16 * sizeof(void*), NULL);
+    _create_snapshot_garbage(&gc, objs, 16);
+    mu_assert(_allocation_count(&gc) == 17, "Wrong allocation map size");
+    _scrub_stack();
+
+    mu_assert(vgc_snapshot_begin(&gc), "Snapshot collection should start");
+    mu_assert(!vgc_snapshot_begin(&gc), "Only one snapshot may be in flight");
+    /* Unreachable, but allocated after the snapshot was taken */
+    _create_unreachable(&gc);
+    while (!vgc_snapshot_poll(&gc)) {
+    }
+    size_t freed = vgc_snapshot_end(&gc);
+    mu_assert(freed == 8 * 16, "Snapshot collection should free the unreachable half");
+    mu_assert(DTOR_COUNT == 8, "Destructors of the unreachable half should run");
+    mu_assert(_allocation_count(&gc) == 10, "Allocations made after the snapshot should survive");
+    for (size_t i=0; i<8; ++i) {
+        mu_assert(vgc_allocation_map_get(gc.allocs, objs[i]), "Reachable allocations should survive");
+    }
+    mu_assert(gc.snapshot == NULL && !gc.allocs->sweeping, "Snapshot state should be reset");
+
+    /* A regular collection now picks up the late allocation */
+    _scrub_stack();
+    vgc_collect(&gc);
+    mu_assert(DTOR_COUNT == 9, "Late allocation should be collected by the next cycle");
+
+    vgc_stop(&gc);
+    DTOR_COUNT = 0;
+    return NULL;
+}
+
+static void _create_weak_targets(vgc_GC* gc, void** roots)
+{
+    /* roots[0] only weakly refers to its target and the target's child, roots[1] also holds its target in roots[2] */
+    void** target = vgc_malloc_ext(gc, 16, dtor);
+    target[0] = vgc_malloc_ext(gc, 16, dtor);
+    target[1] = NULL;
+    roots[0] = vgc_create_weak_ref(gc, target);
+    roots[2] = vgc_malloc_ext(gc, 16, dtor);
+    roots[1] = vgc_create_weak_ref(gc, roots[2]);
+    roots[3] = vgc_create_weak_map(gc);
+    vgc_weak_map_put(roots[3], roots[2], roots[2]);
+}
+
+static void _intern_garbage(vgc_GC* gc, const char* str)
+{
+    vgc_intern(gc, str);
+}
+
+static char* test_gc_snapshot_weak()
+{
+    DTOR_COUNT = 0;
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+
+    void** roots = vgc_malloc_static(&gc, 6 * sizeof(void*), NULL);
+    _create_weak_targets(&gc, roots);
+    _scrub_stack();
+
+    /* Lookups do not wait for the snapshot in flight, and nothing they hand out is swept by it */
+    mu_assert(vgc_snapshot_begin(&gc), "Snapshot collection should start");
+    roots[4] = vgc_weak_ref_get(roots[0]);
+    mu_assert(gc.snapshot != NULL, "Weak ref lookups should not end the snapshot");
+    mu_assert(roots[4] != NULL, "Targets should be handed out before the child reports them");
+    roots[5] = vgc_weak_map_get(roots[3], roots[2]);
+    mu_assert(gc.snapshot != NULL, "Weak map lookups should not end the snapshot");
+    mu_assert(roots[5] == roots[2], "Values of reachable keys should be handed out");
+    vgc_snapshot_end(&gc);
+    mu_assert(DTOR_COUNT == 0, "Handed out targets should not be collected");
+    mu_assert(vgc_allocation_map_get(gc.allocs, ((void**) roots[4])[0]), "Children of handed out targets should stay managed");
+
+    /* Once the weak references to garbage are cleared, lookups no longer hand it out */
+    roots[4] = roots[5] = NULL;
+    _scrub_stack();
+    mu_assert(vgc_snapshot_begin(&gc), "Snapshot collection should start");
+    while (!vgc_snapshot_poll(&gc));
+    mu_assert(vgc_weak_ref_get(roots[0]) == NULL, "Unreachable targets should be cleared");
+    mu_assert(vgc_weak_ref_get(roots[1]) == roots[2], "Reachable targets should be handed out");
+    mu_assert(DTOR_COUNT == 2, "Only the unreachable target and its child should be collected");
+    vgc_snapshot_end(&gc);
+
+    /* Interning does not wait either, and hands out no string that the snapshot sweeps */
+    _intern_garbage(&gc, "label");
+    _scrub_stack();
+    mu_assert(vgc_snapshot_begin(&gc), "Snapshot collection should start");
+    roots[5] = (void*) vgc_intern(&gc, "label");
+    mu_assert(gc.snapshot != NULL, "Interning should not end the snapshot");
+    vgc_snapshot_end(&gc);
+    mu_assert(vgc_allocation_map_get(gc.allocs, roots[5]), "Handed out interned strings should stay managed");
+    mu_assert(vgc_intern(&gc, "label") == roots[5], "Handed out interned strings should stay interned");
+
+    _intern_garbage(&gc, "transient");
+    _scrub_stack();
+    size_t interned = vgc_intern_count(&gc);
+    mu_assert(vgc_snapshot_begin(&gc), "Snapshot collection should start");
+    while (!vgc_snapshot_poll(&gc));
+    mu_assert(vgc_intern_count(&gc) < interned, "Unreachable interned strings should leave the table");
+    vgc_snapshot_end(&gc);
+
+    vgc_stop(&gc);
+    DTOR_COUNT = 0;
+    return NULL;
+}
+#endif
+
+#if defined(VGC_DIRTY_TRACKING)
+static char* test_gc_dirty_pages()
+{
+    vgc_GC gc;
+    void *stack_bp = __builtin_frame_address(0);
+    vgc_start(&gc, stack_bp);
+
+    /* Large enough that each spans pages of its own */
+    size_t size = 4 * (size_t) sysconf(_SC_PAGESIZE);
+    char* a = vgc_calloc(&gc, 1, size);
+    char* b = vgc_calloc(&gc, 1, size);
+    mu_assert(vgc_is_dirty(&gc, a, size), "Without tracking everything should be dirty");
+    mu_assert(vgc_dirty_tracking_start(&gc), "Dirty page tracking should start");
+    mu_assert(!vgc_is_dirty(&gc, a + size / 2, 16), "Unwritten pages should be clean");
+
+    a[size / 2] = 1;
+    mu_assert(vgc_is_dirty(&gc, a + size / 2, 16), "Written pages should be dirty");
+    mu_assert(!vgc_is_dirty(&gc, b + size / 2, 16), "Other pages should stay clean");
+
+    /* A collection starts a new cycle */
+    vgc_collect(&gc);
+    mu_assert(!vgc_is_dirty(&gc, a + size / 2, 16), "Collections should reset dirty pages");
+    b[size / 2] = 1;
+    mu_assert(vgc_is_dirty(&gc, b + size / 2, 16), "Written pages should be dirty");
+    mu_assert(a[size / 2] == 1 && b[size / 2] == 1, "Tracking must not change memory");
+
+    /* New allocations always count as dirty */
+    char* c = vgc_malloc(&gc, size);
+    mu_assert(vgc_is_dirty(&gc, c + size / 2, 16), "New allocations should be dirty");
+
+    vgc_dirty_tracking_stop(&gc);
+    a[0] = b[0] = 2;
+    mu_assert(vgc_is_dirty(&gc, a, size), "Stopping should make everything dirty again");
+    vgc_stop(&gc);
+    return NULL;
+}
+#endif
+
 /*
  * Test runner
  */
 
 int tests_run = 0;
 
-static char* test_suite()
+static const char* test_suite()
 {
     printf("---=[ GC tests\n");
     mu_run_test(test_gc_allocation_new_delete);
     mu_run_test(test_gc_allocation_map_new_delete);
     mu_run_test(test_gc_allocation_map_basic_get);
     mu_run_test(test_gc_allocation_map_put_get_remove);
+    mu_run_test(test_gc_allocation_map_incremental_resize);
     mu_run_test(test_gc_mark_stack);
+    mu_run_test(test_gc_scan_kernels);
+    mu_run_test(test_gc_mark_queue);
     mu_run_test(test_gc_basic_alloc_free);
     mu_run_test(test_gc_allocation_map_cleanup);
+    mu_run_test(test_gc_mark_bitmaps);
     mu_run_test(test_gc_static_allocation);
+    mu_run_test(test_gc_root_set);
     mu_run_test(test_primes);
     mu_run_test(test_gc_realloc);
     mu_run_test(test_gc_disable_enable);
     mu_run_test(test_gc_strdup);
+    mu_run_test(test_gc_compact_array);
+    mu_run_test(test_gc_region);
+    mu_run_test(test_gc_region_nested);
+    mu_run_test(test_gc_malloc_fast);
+#if !defined(VGC_THREADS)
+    mu_run_test(test_gc_allocation_span);
+#endif
+    mu_run_test(test_gc_shadow_roots);
+    mu_run_test(test_gc_noscan);
+    mu_run_test(test_gc_weak);
+    mu_run_test(test_gc_pool);
+    mu_run_test(test_gc_trace);
+    mu_run_test(test_gc_record);
+    mu_run_test(test_gc_buffer_mmap);
+    mu_run_test(test_gc_intern);
+    mu_run_test(test_gc_realloc_in_place);
+    mu_run_test(test_gc_slice);
+    mu_run_test(test_gc_vector);
+#if defined(__linux__)
+    mu_run_test(test_gc_stacks);
+#endif
+#if defined(VGC_SNAPSHOT)
+    mu_run_test(test_gc_snapshot);
+    mu_run_test(test_gc_snapshot_weak);
+#endif
+#if defined(VGC_DIRTY_TRACKING)
+    mu_run_test(test_gc_dirty_pages);
+#endif
+#if defined(VGC_THREADS)
+    mu_run_test(test_gc_threads);
+#endif
     return 0;
 }
 
 int main()
 {
-    char *result = test_suite();
+    const char *result = test_suite();
     if (result) {
         printf("%s\n", result);
     } else {
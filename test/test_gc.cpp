@@ -0,0 +1,229 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "minunit.h"
+
+#include "../src/vgc.cpp"
+
+static size_t DTOR_COUNT = 0;
+
+struct Tracked
+{
+    Tracked *next;
+    int value;
+
+    explicit Tracked(int value) : next(nullptr), value(value)
+    {
+    }
+
+    ~Tracked()
+    {
+        DTOR_COUNT++;
+    }
+};
+
+static void _create_garbage(vgc::GarbageCollector &gc)
+{
+    gc.make_managed<Tracked>(0);
+}
+
+static const char* test_gc_ptr()
+{
+    DTOR_COUNT = 0;
+    vgc::GarbageCollector gc(__builtin_frame_address(0));
+    vgc::GarbageCollector other(__builtin_frame_address(0));
+    gc.set_stack_scanning(false);
+    other.set_stack_scanning(false);
+    {
+        /* Only handles keep objects alive once the stack is not scanned */
+        vgc::gc_ptr<Tracked> a(gc, gc.make_managed<Tracked>(1));
+        _create_garbage(gc);
+        gc.collect();
+        mu_assert(DTOR_COUNT == 1, "Unreferenced objects should be collected");
+        mu_assert(a->value == 1, "Referenced objects should survive");
+
+        /* Assigning a handle of another collector moves the root along */
+        vgc::gc_ptr<Tracked> b(other, other.make_managed<Tracked>(2));
+        a = b;
+        b.reset();
+        mu_assert(a.get() != nullptr && a->value == 2, "Assignment should copy the target");
+        gc.collect();
+        mu_assert(DTOR_COUNT == 2, "The old collector should no longer root the handle");
+        other.collect();
+        mu_assert(DTOR_COUNT == 2, "The new collector should root the handle");
+
+        vgc::gc_ptr<Tracked> c(a);
+        a = nullptr;
+        other.collect();
+        mu_assert(DTOR_COUNT == 2 && c->value == 2, "Copies should root the target as well");
+    }
+    other.collect();
+    mu_assert(DTOR_COUNT == 3, "Destroyed handles should unregister their roots");
+    return NULL;
+}
+
+static const char* test_gc_allocator()
+{
+    vgc::GarbageCollector gc(__builtin_frame_address(0));
+    static_assert(!vgc::allocator<int>::scanned, "Pointer-free storage should not be scanned");
+    static_assert(vgc::allocator<int *>::scanned, "Storage of pointers should be scanned");
+
+    /* The storage of a reachable container survives collections */
+    std::vector<int, vgc::allocator<int>> numbers{vgc::allocator<int>(gc)};
+    for (int i=0; i<1000; ++i) {
+        numbers.push_back(i);
+    }
+    gc.collect();
+    long sum = 0;
+    for (int n : numbers) {
+        sum += n;
+    }
+    mu_assert(sum == 999 * 1000 / 2, "Container storage should survive collections");
+    mu_assert(numbers.get_allocator().collector() == &gc, "The allocator should remember its collector");
+    mu_assert(numbers.get_allocator() == vgc::allocator<long>(gc), "Allocators of one collector should compare equal");
+    return NULL;
+}
+
+static const char* test_gc_make_managed()
+{
+    DTOR_COUNT = 0;
+    vgc::GarbageCollector gc(__builtin_frame_address(0));
+
+    /* Freed objects are destructed and their memory goes back to the pool */
+    mu_assert(gc.add_pool<Tracked>(64 * sizeof(Tracked)), "Adding a pool failed");
+    Tracked* first = gc.make_managed<Tracked>(1);
+    mu_assert(first->value == 1 && first->next == nullptr, "Arguments should be forwarded to the constructor");
+    gc.free(first);
+    mu_assert(DTOR_COUNT == 1, "Freeing should run the destructor");
+    Tracked* second = gc.make_managed<Tracked>(2);
+    mu_assert(second == first, "Pooled memory should be reused");
+    mu_assert(second->value == 2, "Reused memory should be constructed again");
+
+    int* plain = gc.make_managed<int>(7);
+    mu_assert(*plain == 7, "Trivial types should be constructed");
+    long* raw = gc.make_static(gc.malloc<long>());
+    *raw = 42;
+    gc.collect();
+    mu_assert(*raw == 42, "Static objects should survive collections");
+    return NULL;
+}
+
+static const char* test_gc_span_ref()
+{
+    vgc_GC gc;
+    vgc_start(&gc, __builtin_frame_address(0));
+    vgc_Buffer* buffer = vgc_create_buffer(&gc, 10 * sizeof(int));
+    mu_assert(buffer != NULL, "Creating a buffer failed");
+    int* items = (int *) buffer->address;
+    for (int i=0; i<10; ++i) {
+        items[i] = i;
+    }
+
+    /* A view wraps an existing slice without copying */
+    vgc::span_ref<int> view(vgc_create_slice(&gc, buffer, 2 * sizeof(int), 5 * sizeof(int)));
+    mu_assert(view.size() == 5 && view.data() == items + 2 && view[0] == 2, "Views should not copy");
+    int sum = 0;
+    for (int n : view) {
+        sum += n;
+    }
+    mu_assert(sum == 2 + 3 + 4 + 5 + 6, "Views should be iterable");
+
+    vgc::span_ref<int> none;
+    mu_assert(none.empty() && none.data() == nullptr, "Default views should be empty");
+    vgc_stop(&gc);
+    return NULL;
+}
+
+static const char* test_gc_vector()
+{
+    vgc::GarbageCollector gc(__builtin_frame_address(0));
+    vgc::vector<int> v(gc, 4);
+    mu_assert(v.empty() && v.capacity() >= 4, "New vectors should be empty");
+    for (int i=0; i<100; ++i) {
+        v.push_back(i);
+    }
+    mu_assert(v.size() == 100 && v[99] == 99 && v.back() == 99, "Pushed items should be kept");
+    v.pop_back();
+    mu_assert(v.size() == 99, "Popping should drop the last item");
+    gc.collect();
+    mu_assert(v[42] == 42, "Reachable vectors should survive collections");
+
+    /* Views share the storage */
+    vgc::span_ref<int> view = v.subspan(10, 20);
+    mu_assert(view.size() == 20 && view[0] == 10 && view.data() == v.data() + 10, "Views should not copy");
+    vgc::span_ref<int> sub = view.subspan(gc, 5, 5);
+    mu_assert(sub.size() == 5 && sub[0] == 15, "Subspans should view their parent");
+    int sum = 0;
+    for (int n : sub) {
+        sum += n;
+    }
+    mu_assert(sum == 15 + 16 + 17 + 18 + 19, "Views should be iterable");
+    bool thrown = false;
+    try {
+        view.subspan(gc, 15, 10);
+    } catch (const std::out_of_range &) {
+        thrown = true;
+    }
+    mu_assert(thrown, "Subspans past the end should throw");
+
+    v.clear();
+    v.shrink_to_fit();
+    mu_assert(v.empty() && v.capacity() == 0, "Shrinking an empty vector should release its storage");
+    return NULL;
+}
+
+static const char* test_gc_intern()
+{
+    vgc::GarbageCollector gc(__builtin_frame_address(0));
+    char buffer[16];
+    strcpy(buffer, "label");
+    const char* a = gc.intern(buffer);
+    mu_assert(a != buffer && strcmp(a, "label") == 0, "Interning should copy the string");
+    mu_assert(gc.intern("label") == a, "Equal strings should be interned once");
+    char* copy = gc.strdup("label");
+    mu_assert(copy != a && strcmp(copy, a) == 0, "strdup() should return a private copy");
+    return NULL;
+}
+
+static const char* test_gc_region()
+{
+    DTOR_COUNT = 0;
+    vgc::GarbageCollector gc(__builtin_frame_address(0));
+    Tracked* kept;
+    {
+        vgc::Region region(gc);
+        kept = region.promote(gc.make_managed<Tracked>(1));
+        kept->next = gc.make_managed<Tracked>(2);
+        gc.make_managed<Tracked>(3);
+    }
+    mu_assert(DTOR_COUNT == 1, "Region end should destruct objects that were not promoted");
+    mu_assert(kept->value == 1 && kept->next->value == 2, "Promoted objects should survive their region");
+    return NULL;
+}
+
+int tests_run = 0;
+
+static const char* test_suite()
+{
+    printf("---=[ C++ tests\n");
+    mu_run_test(test_gc_ptr);
+    mu_run_test(test_gc_allocator);
+    mu_run_test(test_gc_make_managed);
+    mu_run_test(test_gc_span_ref);
+    mu_run_test(test_gc_vector);
+    mu_run_test(test_gc_intern);
+    mu_run_test(test_gc_region);
+    return 0;
+}
+
+int main()
+{
+    const char *result = test_suite();
+    if (result) {
+        printf("%s\n", result);
+    } else {
+        printf("ALL TESTS PASSED\n");
+    }
+    printf("Tests run: %d\n", tests_run);
+    return result != 0;
+}